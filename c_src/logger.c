@@ -13,37 +13,51 @@
 
 #define HEXLINE_MOD 16
 
-static log_lvl_t curr_log_level = MSG_DEBUG; 
+log_lvl_t log_curr_lvl = MSG_DEBUG; 
 static char log_fname[640] = {0};
 static uint64_t log_max_fsize = 0;   // По умолчанию не задан (ротация лог-файла запрещена)
 static uint max_files_num = 3;
 static uint curr_file_num = 1;
 static log_rotate_cb log_cb = NULL;         
+static FILE *log_fp = NULL;         // Открытый лог-файл (открывается при первой записи)
+static uint64_t log_fsize = 0;      // Текущий размер лог-файла [Байт]
+static log_overload_t log_overload = LOG_OVERLOAD_DROP;
+static uint64_t log_dropped = 0;        // Потерянные записи (всего)
+static uint64_t log_drops_pending = 0;  // Потерянные записи, о которых не было сообщения
+static uint64_t log_drops_reported = 0; // Время последнего сообщения о потерях [мс]
 
 #if LOG_MUTUAL
-pthread_mutex_t log_lvl_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t log_file_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 pthread_mutex_t log_print_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 #endif
 
-// Определение размера файла
-static uint64_t get_filesize (const char* fname)
+// Определение размера открытого файла
+static uint64_t get_filesize (FILE* fp)
 {
     struct stat st;
     memset(&st, 0, sizeof(st));
 
-    if(stat(fname, &st) < 0){
-        log_perr_ex(MSG_ERROR, "\'%s\' stat failed", fname);
+    if(fstat(fileno(fp), &st) < 0){
+        log_perr_ex(MSG_ERROR, "\'%s\' stat failed", log_fname);
         return 0;
     }
 
     return (uint64_t)st.st_size;
 }
 
+// Закрытие лог-файла (вызывается при захваченном log_file_mutex)
+static void log_close_file (void)
+{
+    if(log_fp) fclose(log_fp);
+    log_fp = NULL;
+    log_fsize = 0;
+}
+
 
 // Инициализация логера
 void log_init(const char* fname, uint64_t max_fsize, uint max_files, log_rotate_cb cb)
 {
+    log_reopen();
     if(fname) strcpy(log_fname, fname);
     else strcpy(log_fname, "");
     log_max_fsize = max_fsize;
@@ -52,85 +66,167 @@ void log_init(const char* fname, uint64_t max_fsize, uint max_files, log_rotate_
     log_cb = cb;
 }
 
-// Создание штампа для сообщения: [ дата время ] имя_модуля
-void log_make_stamp (stamp_t type, const char* module_name, char* buf, size_t buf_len)
+#if LOG_MUTUAL
+// Захват блокировки лог-файла согласно политике перегрузки
+bool log_file_trylock(void)
 {
-    char time_str[32] = {0};
-	struct tm timeinfo;
-    struct timespec spec;
-
-    clock_gettime(CLOCK_REALTIME, &spec);
+    if(__atomic_load_n(&log_overload, __ATOMIC_RELAXED) == LOG_OVERLOAD_BLOCK)
+        return !pthread_mutex_lock(&log_file_mutex);
+
+    struct timespec abs_timeout;
+    if(clock_gettime(CLOCK_REALTIME, &abs_timeout) < 0) return false;
+    abs_timeout.tv_nsec += LOG_FILE_LOCK_MS * 1000000L;
+    if(abs_timeout.tv_nsec >= 1000000000L){
+        abs_timeout.tv_sec += 1;
+        abs_timeout.tv_nsec -= 1000000000L;
+    }
+    return !pthread_mutex_timedlock(&log_file_mutex, &abs_timeout);
+}
+#endif
 
-	if(!localtime_r(&spec.tv_sec, &timeinfo)){
-		strncpy(time_str, "localtime_r failed", sizeof time_str);
-		return;
-	}
-    
-    switch(type){
-        case time_stamp: strftime(time_str, sizeof time_str, "[ %T ]", &timeinfo); break;
-        case msec_stamp: 
-            strftime(time_str, sizeof time_str, "%d.%m.%y %T", &timeinfo); 
-            snprintf(buf, buf_len, "[ %s.%03lu ] %s", time_str, spec.tv_nsec / 1000000L, module_name);
-            return;
+// Установка политики перегрузки
+void log_set_overload(log_overload_t policy)
+{
+    __atomic_store_n(&log_overload, policy, __ATOMIC_RELAXED);
+}
 
-        case dtime_stamp: 
-        default:
-            strftime(time_str, sizeof time_str, "[ %d.%m.%y %T ]", &timeinfo); break;
-    }
-    snprintf(buf, buf_len, "%s %s", time_str, module_name);
+// Число потерянных записей
+uint64_t log_get_dropped(void)
+{
+    return __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
 }
 
-// Установка уровня логирования
-inline void log_set_level(log_lvl_t _new_lvl)
+// Сообщение о потерянных записях (вызывается при захваченном log_file_mutex)
+static void log_report_drops(void)
 {
-	log_lvl_lock();
-	curr_log_level = _new_lvl;
-	log_lvl_unlock();
+    if(!__atomic_load_n(&log_drops_pending, __ATOMIC_RELAXED)) return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    if(log_drops_reported && now - log_drops_reported < LOG_DROP_REPORT_MS) return;
+    log_drops_reported = now;
+
+    uint64_t n = __atomic_exchange_n(&log_drops_pending, 0, __ATOMIC_RELAXED);
+    char stamp[64];
+    log_make_stamp(dtime_stamp, MODULE_NAME, stamp, sizeof stamp);
+    int ret = fprintf(log_fp, "%s ------ %" PRIu64 " messages dropped ------\n", stamp, n);
+    if(ret > 0) log_fsize += ret;
 }
 
-// Получение текущего уровня логирования
-inline log_lvl_t log_get_level(void)
+// Переоткрытие лог-файла
+void log_reopen(void)
 {
-	log_lvl_lock();
-	log_lvl_t _ret = curr_log_level;
-	log_lvl_unlock();
-	return _ret;
+#if LOG_MUTUAL
+    pthread_mutex_lock(&log_file_mutex);
+#endif
+    log_close_file();
+#if LOG_MUTUAL
+    pthread_mutex_unlock(&log_file_mutex);
+#endif
 }
 
-// Проверка необходимости логирования сообщения
-inline bool log_check_level(log_lvl_t _flags)
+// Кэш отображения времени штампа (свой у каждого потока). Дата и время перерисовываются
+// только при смене секунды или формата, доли секунды дописываются в подготовленную позицию
+static __thread struct {
+    time_t sec;
+    stamp_t type;
+    char text[48];          // отображение времени
+    size_t len;             // длина отображения времени
+    size_t frac_pos;        // позиция долей секунды в text
+    size_t frac_digits;     // число разрядов долей секунды
+} stamp_cache = { .sec = -1 };
+
+// Создание штампа для сообщения: [ дата время ] имя_модуля
+void log_make_stamp (stamp_t type, const char* module_name, char* buf, size_t buf_len)
 {
-    log_lvl_t _curr_lvl = log_get_level();
-    log_lvl_t _msg_lvl = _flags & LOG_LVL_BIT_MASK;
+    struct timespec spec;
+
+    if(!buf_len) return;
+    buf[0] = '\0';
 
-    // Если сообщение не для файла и не для текущего уровня логирования 
-    if(!(_flags & MSG_TO_FILE) && (_curr_lvl < _msg_lvl)) return false;
+    clock_gettime(CLOCK_REALTIME, &spec);
+
+    if(stamp_cache.sec != spec.tv_sec || stamp_cache.type != type){
+        struct tm timeinfo;
+
+        if(!localtime_r(&spec.tv_sec, &timeinfo)){
+            strncpy(buf, "localtime_r failed", buf_len - 1);
+            return;
+        }
+
+        stamp_cache.frac_digits = 0;
+
+        switch(type){
+            case time_stamp: stamp_cache.len = strftime(stamp_cache.text, sizeof stamp_cache.text, "[ %T ]", &timeinfo); break;
+            case msec_stamp: stamp_cache.frac_digits = 3; break;
+            case usec_stamp: stamp_cache.frac_digits = 6; break;
+            case nsec_stamp: stamp_cache.frac_digits = 9; break;
+            case dtime_stamp: 
+            default:
+                stamp_cache.len = strftime(stamp_cache.text, sizeof stamp_cache.text, "[ %d.%m.%y %T ]", &timeinfo); break;
+        }
+
+        if(stamp_cache.frac_digits){
+            stamp_cache.frac_pos = strftime(stamp_cache.text, sizeof stamp_cache.text, "[ %d.%m.%y %T.", &timeinfo);
+            memcpy(&stamp_cache.text[stamp_cache.frac_pos + stamp_cache.frac_digits], " ]", 2);
+            stamp_cache.len = stamp_cache.frac_pos + stamp_cache.frac_digits + 2;
+        }
+
+        stamp_cache.sec = spec.tv_sec;
+        stamp_cache.type = type;
+    }
+
+    // Доли секунды: 10^9 нс обрезаются до нужного числа разрядов
+    if(stamp_cache.frac_digits){
+        unsigned long frac = spec.tv_nsec;
+        size_t i;
+        for(i = stamp_cache.frac_digits; i < 9; ++i) frac /= 10;
+        for(i = stamp_cache.frac_digits; i > 0; --i){
+            stamp_cache.text[stamp_cache.frac_pos + i - 1] = '0' + frac % 10;
+            frac /= 10;
+        }
+    }
 
-    return true;
+    // Отображение времени + ' ' + имя модуля
+    size_t len = stamp_cache.len < buf_len - 1 ? stamp_cache.len : buf_len - 1;
+    memcpy(buf, stamp_cache.text, len);
+    if(len < buf_len - 1) buf[len++] = ' ';
+
+    size_t mod_len = strlen(module_name);
+    if(mod_len > buf_len - 1 - len) mod_len = buf_len - 1 - len;
+    memcpy(buf + len, module_name, mod_len);
+    buf[len + mod_len] = '\0';
 }
 
-// Запись сообщения в лог-файл
-void log_to_file(const char *stamp, const char *format, ...)
+// Установка уровня логирования
+void log_set_level(log_lvl_t _new_lvl)
 {
-    if( !strcmp(log_fname, "") || !log_max_fsize ) return;
-
-    FILE* logfp = NULL;
-    char str[1024] = {0};
-    
-    va_list args;
-    va_start(args, format);
-    vsnprintf(str, sizeof(str), format, args);
+	__atomic_store_n(&log_curr_lvl, _new_lvl, __ATOMIC_RELAXED);
+}
 
-    log_file_lock();
+// Запись в лог-файл сформированного текста (stamp может быть NULL)
+static void log_file_write(const char *stamp, const char *buf, size_t len)
+{
+    if(!log_file_lock()){
+        __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&log_drops_pending, 1, __ATOMIC_RELAXED);
+        return;
+    }
 
-    uint64_t log_size = get_filesize(log_fname);
-    //log_print("log_size: %" PRIu64 ", log_max_fsize: %" PRIu64 "\n", log_size, log_max_fsize);
+    // Файл открывается однократно, размер отслеживается по объему записанных данных
+    if(!log_fp){
+        log_fp = fopen(log_fname, "a");
+        if(log_fp) log_fsize = get_filesize(log_fp);
+    }
 
-    if ( log_size >= log_max_fsize ){
+    if ( log_fp && log_fsize >= log_max_fsize ){
         log_msg(MSG_VERBOSE, "------ Rotating log file ------\n");
         // call rotation callback function
         if(log_cb) log_cb();
 
+        log_close_file();
+
         // Процедура создания бэкапа лог-файла
         if(max_files_num){
             char *backup_name = NULL;
@@ -141,47 +237,134 @@ void log_to_file(const char *stamp, const char *format, ...)
             }
         }
 
-        logfp = fopen(log_fname, "w+");
-        if(logfp) {
-            if(stamp) fprintf(logfp, "%s", stamp);
-            fprintf(logfp, "------ Log has been rotated ------\n");
+        log_fp = fopen(log_fname, "w");
+        if(log_fp) {
+            int ret = 0;
+            if(stamp) ret = fprintf(log_fp, "%s", stamp);
+            if(ret > 0) log_fsize += ret;
+            ret = fprintf(log_fp, "------ Log has been rotated ------\n");
+            if(ret > 0) log_fsize += ret;
         }
     }
-    else {
-        logfp = fopen(log_fname, "a+");
-    }
 
-    if(logfp){
-    	if(stamp) fprintf(logfp, "%s", stamp);
-        fprintf(logfp, "%s", str);
-        fclose(logfp);
+    if(log_fp){
+        log_report_drops();
+        if(stamp) log_fsize += fwrite(stamp, 1, strlen(stamp), log_fp);
+        log_fsize += fwrite(buf, 1, len, log_fp);
+        fflush(log_fp);
     }
     else log_dbg("Couldnt open log file '%s'\n", log_fname);   
 
     log_file_unlock();
+}
+
+// Запись сообщения в лог-файл
+void log_to_file(const char *stamp, const char *format, ...)
+{
+    if( !strcmp(log_fname, "") || !log_max_fsize ) return;
 
-    format = va_arg(args, char*);
+    char str[1024] = {0};
+    
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(str, sizeof(str), format, args);
     va_end(args);
+
+    if(len < 0) return;
+    if((size_t)len >= sizeof(str)) len = sizeof(str) - 1;
+
+    log_file_write(stamp, str, len);
 }
 
-// Вывод массива байт
-void log_print_arr(log_lvl_t flags, const char* msg, uint8_t* buf, size_t len)
+// Вывод сформированной записи (целиком, одной операцией) в stdout и (или) лог-файл
+static void log_write_record(log_lvl_t flags, const char *rec, size_t len)
 {
-    if(!log_check_level(flags)) return;
+    log_lvl_t msg_lvl = flags & LOG_LVL_BIT_MASK;
+
+    if(msg_lvl && msg_lvl <= log_get_level()){
+        log_print_lock();
+        fwrite(rec, 1, len, stdout);
+        log_print_unlock();
+    }
+
+    if((flags & MSG_TO_FILE) && strcmp(log_fname, "") && log_max_fsize) log_file_write(NULL, rec, len);
+}
+
+// Таблица 16-ричного представления байт: пара символов байта b начинается с позиции 2 * b
+#define HEX_ROW(h)  h"0" h"1" h"2" h"3" h"4" h"5" h"6" h"7" h"8" h"9" h"A" h"B" h"C" h"D" h"E" h"F"
+static const char hex_pairs[] =
+    HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+    HEX_ROW("8") HEX_ROW("9") HEX_ROW("A") HEX_ROW("B") HEX_ROW("C") HEX_ROW("D") HEX_ROW("E") HEX_ROW("F");
+
+// Запись байта в виде "XX "
+static inline char* put_hex (char *p, uint8_t b)
+{
+    memcpy(p, &hex_pairs[2 * b], 2);
+    p[2] = ' ';
+    return p + 3;
+}
+
+// Буфер формирования дампа: небольшие дампы формируются на стеке
+#define HEXDUMP_LOCAL_SIZE  2048
+
+static char* hex_buf_get (char *local, size_t need)
+{
+    return (need <= HEXDUMP_LOCAL_SIZE) ? local : (char*)malloc(need);
+}
 
-    log_print_lock();
+static void hex_buf_put (char *local, char *buf)
+{
+    if(buf != local) free(buf);
+}
 
-    log_msg_ex(dtime_stamp, flags, "%s", msg);
-    for (int i = 0; i < len; i++){
-        if (i != 0 && i % (HEXLINE_MOD / 2) == 0)
-            log_msg_ex(no_stamp, flags, "  ");
+// Байты в виде "XX XX ... " с разделением групп по 8 байт и строк по HEXLINE_MOD байт
+static char* put_hex_arr (char *p, const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++){
+        if (i != 0 && i % (HEXLINE_MOD / 2) == 0){
+            *p++ = ' ';
+            *p++ = ' ';
+        }
         if (i != 0 && i % HEXLINE_MOD == 0)
-            log_msg_ex(no_stamp, flags, "\n");
-        log_msg_ex(no_stamp, flags, "%02X ", buf[i]);
+            *p++ = '\n';
+        p = put_hex(p, buf[i]);
     }
-    log_msg_ex(no_stamp, flags, "\n");
+    *p++ = '\n';
 
-    log_print_unlock();
+    return p;
+}
+
+// Максимальная длина put_hex_arr() для len байт
+static size_t hex_arr_size (size_t len)
+{
+    return len * 3 + (len / (HEXLINE_MOD / 2)) * 2 + len / HEXLINE_MOD + 1;
+}
+
+// Вывод массива байт
+void log_print_arr(log_lvl_t flags, const char* msg, uint8_t* buf, size_t len)
+{
+    if(!log_check_level(flags)) return;
+
+    char stamp[64];
+    log_make_stamp(dtime_stamp, MODULE_NAME, stamp, sizeof stamp);
+    size_t stamp_len = strlen(stamp);
+    size_t msg_len = strlen(msg);
+
+    char local[HEXDUMP_LOCAL_SIZE];
+    char *rec = hex_buf_get(local, stamp_len + 1 + msg_len + hex_arr_size(len));
+    if(!rec) return;
+
+    // Штамп, сообщение и дамп формируются в одном буфере и выводятся одной записью
+    char *p = rec;
+    memcpy(p, stamp, stamp_len);
+    p += stamp_len;
+    *p++ = ' ';
+    memcpy(p, msg, msg_len);
+    p += msg_len;
+    p = put_hex_arr(p, buf, len);
+
+    log_write_record(flags, rec, p - rec);
+    hex_buf_put(local, rec);
 }
 
 
@@ -192,53 +375,87 @@ static unsigned char toprint (const unsigned char chr)
 	return ((chr > 0x1f && chr < 0x7f) || (chr >= 0x80 && chr < 0xFF)) ? chr : '.';
 }
 
-static void log_hexline (log_lvl_t flags, const unsigned char *dump, size_t len) 
+// Строка дампа: до HEXLINE_MOD байт в 16-ричном виде и их символьное представление
+static char* put_hexline (char *p, const unsigned char *dump, size_t len) 
 {
 	size_t i;
-	char str[HEXLINE_MOD + 1] = {0};
+	char str[HEXLINE_MOD];
 
 	for (i = 0; i < len && i < HEXLINE_MOD; i++) {
-		log_msg_ex(no_stamp, flags, "%02X ", dump[i]);
+		p = put_hex(p, dump[i]);
 		str[i] = toprint (dump[i]);
 		if (i == HEXLINE_MOD / 2 - 1)
-			log_msg_ex(no_stamp, flags, " ");
+			*p++ = ' ';
 	}
+	size_t n = i;
 	for (; i < HEXLINE_MOD; i++) {
 		if (i == HEXLINE_MOD / 2 - 1)
-			log_msg_ex(no_stamp, flags, " ");
-		log_msg_ex(no_stamp, flags, "   ");
+			*p++ = ' ';
+		memcpy(p, "   ", 3);
+		p += 3;
 	}
-	log_msg_ex(no_stamp, flags, " |%s|", str);
+
+	*p++ = ' ';
+	*p++ = '|';
+	memcpy(p, str, n);
+	p += n;
+	*p++ = '|';
+
+	return p;
 }
 
 void log_hexdump (log_lvl_t flags, const void *_dump, size_t len, size_t offset) 
 {
     if(!log_check_level(flags)) return;
 
-	const unsigned char *dump = (const unsigned char*) _dump;
-	for (size_t i = 0; i < len; i += HEXLINE_MOD) {
+    char stamp[64];
+    log_make_stamp(dtime_stamp, MODULE_NAME, stamp, sizeof stamp);
+    size_t stamp_len = strlen(stamp);
+
+    // Строка: штамп ' ' смещение "  " байты(3 * HEXLINE_MOD + 1) " |" символы "|\n"
+    size_t line_max = stamp_len + 1 + 2 * sizeof(size_t) + 2 + 3 * HEXLINE_MOD + 1 + 2 + HEXLINE_MOD + 2;
+    size_t lines = (len + HEXLINE_MOD - 1) / HEXLINE_MOD;
 
-		log_msg_ex(dtime_stamp, flags, "%08zx  ", offset + i);
+    char local[HEXDUMP_LOCAL_SIZE];
+    char *rec = hex_buf_get(local, lines * line_max);
+    if(!rec) return;
 
-		log_hexline(flags, &dump[i], len - i);
-		log_msg_ex(no_stamp, flags, "\n");
+	const unsigned char *dump = (const unsigned char*) _dump;
+	char *p = rec;
+	for (size_t i = 0; i < len; i += HEXLINE_MOD) {
+		memcpy(p, stamp, stamp_len);
+		p += stamp_len;
+		*p++ = ' ';
+
+		// Смещение: не менее 8 16-ричных разрядов (как "%08zx")
+		size_t off = offset + i;
+		int digits = 8;
+		while (digits < (int)(2 * sizeof off) && (off >> (4 * digits))) digits++;
+		for (int d = digits - 1; d >= 0; --d, off >>= 4) p[d] = "0123456789abcdef"[off & 0xF];
+		p += digits;
+		*p++ = ' ';
+		*p++ = ' ';
+
+		p = put_hexline(p, &dump[i], len - i);
+		*p++ = '\n';
 	}
+
+    log_write_record(flags, rec, p - rec);
+    hex_buf_put(local, rec);
 }
 
 void log_hexstr (log_lvl_t flags, const void *_dump, size_t len) 
 {
     if(!log_check_level(flags)) return;
 
-	const unsigned char *dump = (unsigned char*) _dump;
-	size_t i;
-	for (i = 0; i < len; i++) {
-		if (i != 0 && i % (HEXLINE_MOD / 2) == 0)
-			log_msg_ex(no_stamp, flags, "  ");
-		if (i != 0 && i % HEXLINE_MOD == 0)
-			log_msg_ex(no_stamp, flags, "\n");
-		log_msg_ex(no_stamp, flags, "%02X ", dump[i]);
-	}
-	log_msg_ex(no_stamp, flags, "\n");
+    char local[HEXDUMP_LOCAL_SIZE];
+    char *rec = hex_buf_get(local, hex_arr_size(len));
+    if(!rec) return;
+
+    char *p = put_hex_arr(rec, (const uint8_t*)_dump, len);
+
+    log_write_record(flags, rec, p - rec);
+    hex_buf_put(local, rec);
 }
 
 
@@ -249,5 +466,14 @@ int main(int argc, char* argv[])
     log_set_level(MSG_DEBUG);
     const char *text = "Hello logger";
     log_msg(MSG_DEBUG | MSG_TO_FILE, "Message to stdout AND to file: %s\n", text);
+    log_hexdump(MSG_DEBUG | MSG_TO_FILE, text, strlen(text), 0);
+
+    for(int i = 0; i < 1000; ++i){
+        log_msg_every_n(400, MSG_DEBUG | MSG_TO_FILE, "packet #%d dropped\n", i);
+        log_msg_first_n(2, MSG_DEBUG, "first packets: #%d\n", i);
+    }
+
+    log_set_overload(LOG_OVERLOAD_BLOCK);
+    log_msg(MSG_DEBUG | MSG_TO_FILE, "Overload policy: block, dropped %" PRIu64 "\n", log_get_dropped());
 }
 #endif
\ No newline at end of file
@@ -6,31 +6,24 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 
 // Глобальная настройка приложения: разрешение синхронизации вывода
 #if APP_PTHREADED
 	#include <pthread.h>
 	#define LOG_MUTUAL	1
-	extern pthread_mutex_t log_lvl_mutex;
 	extern pthread_mutex_t log_file_mutex;
 	extern pthread_mutex_t log_print_mutex;
-	#define	log_lvl_lock() 		pthread_mutex_lock(&log_lvl_mutex);
-	#define log_lvl_unlock() 	pthread_mutex_unlock(&log_lvl_mutex);
-	// Файл может быть недоступен, чтобы потоки не зависали в ожидании - таймаут на мьютекс 10 мс
-	#define	log_file_lock()		do{												\
-		struct timespec abs_timeout; 											\
-	    if(clock_gettime(CLOCK_REALTIME, &abs_timeout) < 0) return; 			\
-	    abs_timeout.tv_nsec += 10*1000000; 										\
-		if(pthread_mutex_timedlock(&log_file_mutex, &abs_timeout)) return; 		\
-	}while(0)
+	// Файл может быть недоступен, чтобы потоки не зависали в ожидании - таймаут на мьютекс LOG_FILE_LOCK_MS
+	// (см. log_set_overload()). false - блокировка не получена, запись отбрасывается
+	bool log_file_trylock(void);
+	#define	log_file_lock()		log_file_trylock()
 	#define log_file_unlock()	pthread_mutex_unlock(&log_file_mutex);
 	#define	log_print_lock() 	pthread_mutex_lock(&log_print_mutex);
 	#define log_print_unlock() 	pthread_mutex_unlock(&log_print_mutex);
 #else 
 	#define LOG_MUTUAL	0
-	#define	log_lvl_lock()
-	#define log_lvl_unlock()
-	#define log_file_lock()
+	#define log_file_lock()		(true)
 	#define log_file_unlock()
 	#define	log_print_lock()
 	#define log_print_unlock()
@@ -49,6 +42,10 @@
 #define _KB(x)		( (uint64_t)((x) * 1024 ) )
 
 #define DFLT_FILE_SIZE	( _MB(2) )
+// Максимальное время ожидания блокировки лог-файла [мс]
+#define LOG_FILE_LOCK_MS		10
+// Минимальный интервал между сообщениями о потерянных записях [мс]
+#define LOG_DROP_REPORT_MS		1000
 
 // Функция вывода лога в терминал
 #define log_print(str...) 		printf(str)
@@ -74,6 +71,15 @@ typedef void (*log_rotate_cb)(void);
 // Битовая маска выделения уровня сообщения (7бит)
 #define LOG_LVL_BIT_MASK		( (log_lvl_t)(0x7F) )
 
+// Максимальный уровень сообщений, включаемых в сборку. Вызовы макросов с более подробным уровнем
+// удаляются компилятором (например, -DLOG_COMPILE_LVL=MSG_DEBUG исключает MSG_VERBOSE и выше)
+#ifndef LOG_COMPILE_LVL
+	#define LOG_COMPILE_LVL		MSG_OVERTRACE
+#endif
+
+// Текущий уровень логирования. Доступ только через log_get_level() / log_set_level()
+extern log_lvl_t log_curr_lvl;
+
 
 /**
   * @описание   Инициализация логера
@@ -87,12 +93,41 @@ typedef void (*log_rotate_cb)(void);
  */
 void log_init(const char* fname, uint64_t max_fsize, uint max_files, log_rotate_cb cb);
 
+/**
+  * @описание   Переоткрытие лог-файла (например, после его перемещения внешней утилитой типа logrotate).
+  *             Файл будет открыт заново при следующей записи
+ */
+void log_reopen(void);
+
+// Поведение при занятости лог-файла дольше LOG_FILE_LOCK_MS
+typedef enum {
+	LOG_OVERLOAD_BLOCK = 0,		// ожидание без ограничения времени
+	LOG_OVERLOAD_DROP			// отбрасывание записи (по умолчанию)
+}log_overload_t;
+
+/**
+  * @описание   Установка политики перегрузки. О потерянных записях в лог-файл выводится сообщение
+  *             "N messages dropped" (не чаще LOG_DROP_REPORT_MS)
+  * @параметры
+  *     Входные:
+  *         policy - политика перегрузки
+ */
+void log_set_overload(log_overload_t policy);
+
+/**
+  * @описание   Получение числа записей, потерянных из-за перегрузки
+  * @возвращает Число записей с момента запуска
+ */
+uint64_t log_get_dropped(void);
+
 // Типы поддерживаемых форматов штампа сообщения
 typedef enum {
 	no_stamp = 0,
 	dtime_stamp,
 	time_stamp,
-	msec_stamp
+	msec_stamp,
+	usec_stamp,
+	nsec_stamp
 }stamp_t;
 
 /**
@@ -116,10 +151,13 @@ void log_make_stamp (stamp_t type, const char* module_name, char* buf, size_t bu
 void log_set_level(log_lvl_t new_lvl);
 
 /**
-  * @описание   Получение текущего уровня логирования
+  * @описание   Получение текущего уровня логирования (атомарное чтение без блокировки)
   * @возвращает Текущий уровень логирования
  */
-log_lvl_t log_get_level(void);
+static inline log_lvl_t log_get_level(void)
+{
+	return __atomic_load_n(&log_curr_lvl, __ATOMIC_RELAXED);
+}
 
 /**
   * @описание   Проверка необходимости логирования сообщения
@@ -128,7 +166,18 @@ log_lvl_t log_get_level(void);
   *         flags - флаги уровня сообщения
   * @возвращает true если сообщение надо логировать, иначе - false
  */
-bool log_check_level(log_lvl_t flags);
+static inline bool log_check_level(log_lvl_t flags)
+{
+	log_lvl_t msg_lvl = flags & LOG_LVL_BIT_MASK;
+
+	// Уровень исключен из сборки
+	if(msg_lvl > LOG_COMPILE_LVL) return false;
+
+	// Если сообщение не для файла и не для текущего уровня логирования 
+	if(!(flags & MSG_TO_FILE) && (log_get_level() < msg_lvl)) return false;
+
+	return true;
+}
 
 /**
   * @описание   Запись сообщения в лог-файл
@@ -172,6 +221,7 @@ void log_hexstr (log_lvl_t flags, const void *_dump, size_t len);
 #define log_msg_ex(stamp, flags, str...) do{ 									\
 	if(!strcmp(MODULE_NAME, "")) break; 										\
 	if(!(flags)) break; 														\
+	if(((flags) & LOG_LVL_BIT_MASK) > LOG_COMPILE_LVL) break; 					\
 	log_lvl_t _curr_lvl = log_get_level(); 										\
 	log_lvl_t _msg_lvl = (flags) & LOG_LVL_BIT_MASK;							\
 	if(!((flags) & MSG_TO_FILE) && (_curr_lvl < _msg_lvl)) break; 				\
@@ -191,6 +241,71 @@ void log_hexstr (log_lvl_t flags, const void *_dump, size_t len);
 #define log_dbg(str...)			log_msg_ex(dtime_stamp, MSG_DEBUG, str)
 
 
+// Ограничение частоты вывода в месте вызова. Состояние хранится в статической памяти места вызова,
+// решение о пропуске записи принимается атомарными операциями без блокировок и форматирования
+typedef struct {
+	uint64_t count;			// число обращений
+	uint64_t suppressed;	// число пропущенных записей после последнего вывода
+	int64_t last_ms;		// время последнего вывода [мс] + 1 (0 - вывода не было)
+}log_limit_t;
+
+// Каждая n-я запись (первая выводится)
+static inline bool log_limit_every_n(log_limit_t *l, uint64_t n)
+{
+	return n <= 1 || __atomic_fetch_add(&l->count, 1, __ATOMIC_RELAXED) % n == 0;
+}
+
+// Только первые n записей
+static inline bool log_limit_first_n(log_limit_t *l, uint64_t n)
+{
+	return __atomic_load_n(&l->count, __ATOMIC_RELAXED) < n && __atomic_fetch_add(&l->count, 1, __ATOMIC_RELAXED) < n;
+}
+
+// Не чаще одной записи за ms миллисекунд (время - по грубым часам, с разрешением системного таймера)
+static inline bool log_limit_every_ms(log_limit_t *l, uint64_t ms)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	int64_t now = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + 1;
+	int64_t prev = __atomic_load_n(&l->last_ms, __ATOMIC_RELAXED);
+
+	if(prev && now - prev < (int64_t)ms) return false;
+	return __atomic_compare_exchange_n(&l->last_ms, &prev, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Случайная выборка: запись выводится с вероятностью p
+static inline bool log_limit_sampled(log_limit_t *l, double p)
+{
+	(void)l;
+	// xorshift32 - свой у каждого потока
+	static __thread uint32_t state = 2463534242u;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state < p * 4294967296.0;
+}
+
+// Вывод сообщения (как log_msg_ex) при выполнении условия cond, вычисляемого для состояния _log_limit.
+// Перед выводом сообщается число пропущенных с прошлого вывода записей
+#define log_limited_ex(cond, stamp, flags, str...) do{							\
+	static log_limit_t _log_limit; 												\
+	if(!log_check_level(flags)) break;											\
+	if(!(cond)){ 																\
+		__atomic_add_fetch(&_log_limit.suppressed, 1, __ATOMIC_RELAXED); 		\
+		break; 																	\
+	} 																			\
+	uint64_t _log_supp = __atomic_exchange_n(&_log_limit.suppressed, 0, __ATOMIC_RELAXED); \
+	if(_log_supp) log_msg_ex(stamp, (flags), "[ %llu similar messages suppressed ]\n", (unsigned long long)_log_supp); \
+	log_msg_ex(stamp, (flags), str); 											\
+}while(0)
+
+// Каждая n-я запись, первые n записей, не чаще одной записи за ms [мс], с вероятностью p
+#define log_msg_every_n(n, flags, str...)	log_limited_ex(log_limit_every_n(&_log_limit, (n)), dtime_stamp, (flags), str)
+#define log_msg_first_n(n, flags, str...)	log_limited_ex(log_limit_first_n(&_log_limit, (n)), dtime_stamp, (flags), str)
+#define log_msg_every_ms(ms, flags, str...)	log_limited_ex(log_limit_every_ms(&_log_limit, (ms)), dtime_stamp, (flags), str)
+#define log_msg_sampled(p, flags, str...)	log_limited_ex(log_limit_sampled(&_log_limit, (p)), dtime_stamp, (flags), str)
+
+
 #define ERR_BUF_SIZE			256
 
 // Вывод сообщения об ошибке
@@ -0,0 +1,252 @@
+// Замеры производительности логера (C) по тем же сценариям, что и logger-bench для C++:
+// log_msg(), макросы log_err(), log_hexdump() и отброшенные по уровню вызовы для 1..N потоков
+// и вывода в stdout (/dev/null), в файл и без вывода. Для каждого замера выводятся пропускная
+// способность и задержка вызова (p50/p99/p999), результаты дополнительно сохраняются в формате JSON.
+//
+// Сборка: с APP_PTHREADED=1 (синхронизация вывода потоков)
+// Использование: logger-bench-c [-n число итераций на поток] [-t максимальное число потоков] [-j файл JSON]
+// Файл JSON по умолчанию - logger-bench-c.json ("-" - вывод в stdout)
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LOG_MODULE_NAME     "[ BENCH ]"
+#include "logger.h"
+
+#define BENCH_LOG_FILE      "logger-bench-c.log"
+#define BENCH_MAX_RESULTS   128
+
+// Результат замера
+typedef struct {
+    const char *op;
+    const char *sink;
+    unsigned threads;
+    uint64_t calls;
+    double seconds;
+    double p50, p99, p999, max;     // [нс]
+} result_t;
+
+static result_t results[BENCH_MAX_RESULTS];
+static size_t results_num = 0;
+
+// Параметры текущего замера
+typedef struct {
+    int op;                         // индекс операции в ops[]
+    size_t iters;
+    unsigned th;
+    uint32_t *lat;                  // задержки вызовов потока [нс]
+} worker_t;
+
+static const char *ops[] = {"log_msg", "log_err", "log_hexdump", "filtered"};
+static const char *sinks[] = {"none", "devnull", "file"};
+
+static volatile unsigned ready = 0;
+static volatile int go = 0;
+static uint8_t dump[64];
+
+static inline uint64_t now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void call (int op, unsigned th, size_t i)
+{
+    const char *name = "connection";
+
+    switch(op){
+        case 0: log_msg(MSG_DEBUG | MSG_TO_FILE, "%s #%u: %zu bytes, load %.3f\n", name, th, i, 0.734); break;
+        case 1: log_err("%s #%u: request %zu failed\n", name, th, i); break;
+        case 2: log_hexdump(MSG_DEBUG | MSG_TO_FILE, dump, sizeof dump, 0); break;
+        default: log_msg(MSG_TRACE, "%s #%u: %zu bytes\n", name, th, i); break;
+    }
+}
+
+// Поток замера: прогрев, одновременный старт с остальными потоками, замер каждого вызова
+static void* worker (void *arg)
+{
+    worker_t *w = arg;
+    size_t warm = w->iters / 10 < 1000 ? w->iters / 10 : 1000;
+
+    for(size_t i = 0; i < warm; ++i) call(w->op, w->th, i);
+
+    __atomic_add_fetch(&ready, 1, __ATOMIC_SEQ_CST);
+    while(!__atomic_load_n(&go, __ATOMIC_ACQUIRE)) sched_yield();
+
+    for(size_t i = 0; i < w->iters; ++i){
+        uint64_t t = now_ns();
+        call(w->op, w->th, i);
+        uint64_t d = now_ns() - t;
+        w->lat[i] = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    }
+
+    return NULL;
+}
+
+static int cmp_u32 (const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile (const uint32_t *lat, size_t n, double q)
+{
+    size_t k = (size_t)(q * n);
+    return lat[k < n ? k : n - 1];
+}
+
+// Замер: threads потоков по iters вызовов операции op
+static int measure (int op, const char *sink, unsigned threads, size_t iters, result_t *r)
+{
+    pthread_t tids[threads];
+    worker_t ws[threads];
+    uint32_t *lat = malloc(sizeof(uint32_t) * iters * threads);
+    if(!lat) return -1;
+
+    ready = 0;
+    go = 0;
+    for(unsigned th = 0; th < threads; ++th){
+        ws[th] = (worker_t){ .op = op, .iters = iters, .th = th, .lat = &lat[th * iters] };
+        pthread_create(&tids[th], NULL, worker, &ws[th]);
+    }
+
+    while(__atomic_load_n(&ready, __ATOMIC_SEQ_CST) < threads) sched_yield();
+    uint64_t start = now_ns();
+    __atomic_store_n(&go, 1, __ATOMIC_RELEASE);
+
+    for(unsigned th = 0; th < threads; ++th) pthread_join(tids[th], NULL);
+    fflush(stdout);
+
+    size_t n = iters * threads;
+    *r = (result_t){ .op = ops[op], .sink = sink, .threads = threads, .calls = n,
+        .seconds = (now_ns() - start) / 1e9 };
+
+    qsort(lat, n, sizeof *lat, cmp_u32);
+    r->p50 = percentile(lat, n, 0.5);
+    r->p99 = percentile(lat, n, 0.99);
+    r->p999 = percentile(lat, n, 0.999);
+    r->max = lat[n - 1];
+
+    free(lat);
+    return 0;
+}
+
+static void print_result (FILE *fp, const result_t *r)
+{
+    fprintf(fp, "scenario     %-26s %-8s %2u th %10.1f ns/call %11.0f calls/s  p50 %7.0f  p99 %7.0f  p999 %8.0f ns\n",
+        r->op, r->sink, r->threads, r->seconds * 1e9 / r->calls, r->calls / r->seconds, r->p50, r->p99, r->p999);
+    fflush(fp);
+}
+
+static void remove_logs (void)
+{
+    unlink(BENCH_LOG_FILE);
+    unlink(BENCH_LOG_FILE ".1");
+    unlink(BENCH_LOG_FILE ".2");
+}
+
+// Сохранение результатов в формате JSON (та же схема, что и у logger-bench)
+static int write_json (const char *path, size_t iters, unsigned max_threads)
+{
+    FILE *fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if(!fp){
+        perror(path);
+        return -1;
+    }
+
+    fprintf(fp, "{\n  \"suite\": \"logger-c\",\n  \"iterations\": %zu,\n  \"max_threads\": %u,\n  \"results\": [\n",
+        iters, max_threads);
+
+    for(size_t i = 0; i < results_num; ++i){
+        const result_t *r = &results[i];
+        fprintf(fp, "    {\"group\": \"scenario\", \"op\": \"%s\", \"sink\": \"%s\", \"threads\": %u, "
+            "\"calls\": %" PRIu64 ", \"seconds\": %.6f, \"ns_per_call\": %.1f, \"calls_per_sec\": %.0f, "
+            "\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f}%s\n",
+            r->op, r->sink, r->threads, r->calls, r->seconds, r->seconds * 1e9 / r->calls, r->calls / r->seconds,
+            r->p50, r->p99, r->p999, r->max, (i + 1 < results_num) ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n}\n");
+    if(fp != stdout) fclose(fp);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t iters = 100000;
+    unsigned max_threads = 4;
+    const char *json_path = "logger-bench-c.json";
+
+    for(int i = 1; i < argc; ++i){
+        if(!strcmp(argv[i], "-n") && i + 1 < argc) iters = strtoull(argv[++i], NULL, 10);
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc) max_threads = strtoul(argv[++i], NULL, 10);
+        else if(!strcmp(argv[i], "-j") && i + 1 < argc) json_path = argv[++i];
+        else{
+            printf("Usage: %s [-n iterations] [-t max_threads] [-j results.json]\n", argv[0]);
+            return strcmp(argv[i], "-h") ? 1 : 0;
+        }
+    }
+    if(!iters) iters = 1;
+    if(!max_threads) max_threads = 1;
+
+    for(size_t i = 0; i < sizeof dump; ++i) dump[i] = (uint8_t)i;
+
+    printf("Scenarios: %zu calls per thread, 1..%u threads\n", iters, max_threads);
+
+    for(size_t s = 0; s < sizeof sinks / sizeof sinks[0]; ++s){
+        bool to_file = !strcmp(sinks[s], "file");
+        bool to_stdout = !strcmp(sinks[s], "devnull");
+
+        // Вывод в stdout разрешен уровнем только для devnull, в файл - только для file
+        log_set_level(MSG_SILENT);
+        log_init(to_file ? BENCH_LOG_FILE : NULL, _MB(64), 2, NULL);
+        log_set_level(to_stdout ? MSG_DEBUG : MSG_SILENT);
+
+        for(int op = 0; op < (int)(sizeof ops / sizeof ops[0]); ++op){
+            for(unsigned threads = 1; ; threads = (threads * 2 < max_threads) ? threads * 2 : max_threads){
+                if(results_num >= BENCH_MAX_RESULTS) break;
+
+                // Вывод stdout в /dev/null на время замера
+                int saved = -1;
+                if(to_stdout){
+                    fflush(stdout);
+                    saved = dup(STDOUT_FILENO);
+                    int fd = open("/dev/null", O_WRONLY);
+                    if(fd >= 0){
+                        dup2(fd, STDOUT_FILENO);
+                        close(fd);
+                    }
+                }
+
+                result_t *r = &results[results_num];
+                int ret = measure(op, sinks[s], threads, iters, r);
+
+                if(saved >= 0){
+                    dup2(saved, STDOUT_FILENO);
+                    close(saved);
+                }
+
+                if(!ret){
+                    print_result(stdout, r);
+                    ++results_num;
+                }
+                if(threads >= max_threads) break;
+            }
+        }
+
+        log_set_level(MSG_SILENT);
+        log_init(NULL, 0, 2, NULL);
+        if(to_file) remove_logs();
+    }
+
+    return write_json(json_path, iters, max_threads) ? 1 : 0;
+}
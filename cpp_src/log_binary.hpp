@@ -0,0 +1,213 @@
+#ifndef _LOG_BINARY_HPP
+#define _LOG_BINARY_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <string_view>
+
+#include "log_format.hpp"
+
+// Бинарный формат лог-файла (режим отложенного форматирования).
+// Сообщение хранит идентификатор строки формата, время и сырые значения аргументов,
+// текст восстанавливается утилитой logger-decode.
+//
+// Файл состоит из сессий. Сессия начинается при каждом открытии файла логером:
+//	'H' "LOGB" version 										- заголовок сессии
+//	'D' id kind len text 									- определение строки (формат или имя модуля),
+//															  предшествует первой записи сессии, которая ее использует
+//	'M' flags stamp_type fmt_id mod_id [stamp_fmt_id] sec nsec argc args...	- сообщение
+//	'E' flags name_id mod_id sec nsec fieldc (key arg)...					- структурированное событие
+// Целые числа (кроме флагов и типов) кодируются как varint (LEB128), знаковые - zigzag.
+// Идентификатор 0 означает, что строка записана непосредственно в сообщении: len text.
+// Аргумент: тип + значение
+//	'w' - знаковое целое типа int (после продвижения), 'i' - знаковое целое большей разрядности,
+//	'u' - беззнаковое целое, 'd' - double, 'L' - long double, 's' - строка (len text), 'p' - указатель,
+//	'b' - логическое значение, 'x' - блок байт для 16-ричного дампа (delim len bytes).
+// Разрядность знакового целого сохраняется для вывода отрицательных значений по %x, %o, %u так же,
+// как в текстовом режиме (версия 1 записывала все знаковые целые как 'i', версия 2 - дамп как строку)
+namespace log_bin {
+
+constexpr char magic[4] = {'L', 'O', 'G', 'B'};
+constexpr uint8_t version = 3;
+
+enum : uint8_t {
+	rec_session = 'H',
+	rec_define = 'D',
+	rec_message = 'M',
+	rec_event = 'E',
+};
+
+enum : uint8_t {
+	kind_fmt = 0,			// строка формата сообщения или штампа
+	kind_module = 1,		// имя модуля
+};
+
+enum : uint8_t {
+	arg_int32 = 'w',
+	arg_int = 'i',
+	arg_uint = 'u',
+	arg_double = 'd',
+	arg_ldouble = 'L',
+	arg_str = 's',
+	arg_ptr = 'p',
+	arg_bool = 'b',
+	arg_blob = 'x',
+};
+
+// Блок байт 16-ричного дампа (см. Logging::hex_dump()): записывается без преобразования,
+// дамп формируется при выводе по delim байт в строке
+struct blob{
+	const uint8_t *data;
+	size_t len;
+	uint8_t delim;
+};
+
+// Запись в буфер фиксированного размера. При нехватке места запись прекращается (ok() == false)
+class writer
+{
+public:
+	writer(char *buf, size_t size): beg(buf), cur(buf), end(buf + size) {}
+
+	bool ok() const { return good; }
+	size_t size() const { return cur - beg; }
+
+	void u8(uint8_t v){
+		if(cur < end) *cur++ = (char)v;
+		else good = false;
+	}
+
+	void varint(uint64_t v){
+		while(v >= 0x80){
+			u8((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		u8((uint8_t)v);
+	}
+
+	void svarint(int64_t v){ varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+
+	void bytes(const void *p, size_t len){
+		if((size_t)(end - cur) < len){ good = false; return; }
+		std::memcpy(cur, p, len);
+		cur += len;
+	}
+
+	void str(const char *s, size_t len){
+		varint(len);
+		bytes(s, len);
+	}
+
+private:
+	char *beg;
+	char *cur;
+	char *end;
+	bool good = true;
+};
+
+// Кодирование аргументов сообщения по их типу
+inline void put_arg(writer &w, const char *s){
+	if(!s) s = "(null)";
+	w.u8(arg_str);
+	w.str(s, std::strlen(s));
+}
+inline void put_arg(writer &w, char *s) { put_arg(w, (const char*)s); }
+inline void put_arg(writer &w, const std::string &s) { w.u8(arg_str); w.str(s.data(), s.size()); }
+inline void put_arg(writer &w, std::string_view s) { w.u8(arg_str); w.str(s.data(), s.size()); }
+inline void put_arg(writer &w, bool b) { w.u8(arg_bool); w.u8(b ? 1 : 0); }
+inline void put_arg(writer &w, std::nullptr_t) { w.u8(arg_ptr); w.varint(0); }
+inline void put_arg(writer &w, long double v) { w.u8(arg_ldouble); w.bytes(&v, sizeof v); }
+inline void put_arg(writer &w, const blob &b) { w.u8(arg_blob); w.u8(b.delim); w.str((const char*)b.data, b.len); }
+
+// Размер аргумента сверх LOG_RECORD_MAX_LEN: ограничение длины записи не распространяется на блок дампа
+template<typename T>
+inline size_t extra_size(const T&) { return 0; }
+inline size_t extra_size(const blob &b) { return b.len; }
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+put_arg(writer &w, T v)
+{
+	using P = typename log_fmt::promoted<T>::type;
+	if(std::is_signed<P>::value){ w.u8(sizeof(P) <= sizeof(int32_t) ? arg_int32 : arg_int); w.svarint((int64_t)v); }
+	else { w.u8(arg_uint); w.varint((uint64_t)v); }
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+put_arg(writer &w, T v)
+{
+	double d = v;
+	w.u8(arg_double);
+	w.bytes(&d, sizeof d);
+}
+
+template<typename T>
+inline void put_arg(writer &w, T *p) { w.u8(arg_ptr); w.varint((uint64_t)(uintptr_t)p); }
+
+// Пользовательские типы (log_formatter) форматируются при записи и хранятся как строка
+template<typename T>
+inline typename std::enable_if<log_fmt::has_formatter<T>::value>::type
+put_arg(writer &w, const T &v)
+{
+	log_buf b;
+	log_formatter<T>::format(b, v);
+	w.u8(arg_str);
+	w.str(b.data(), b.size());
+}
+
+// Кодирование значения поля структурированного события (так же, как аргумента сообщения)
+template<typename T>
+inline void put_field(writer &w, const T &v)
+{
+	put_arg(w, v);
+}
+
+// Общий для процесса реестр строк: форматов (по адресу строки со статическим временем жизни)
+// и имен модулей (по содержимому). Поиск выполняется без блокировок, добавление новой строки -
+// под блокировкой реестра. Строки нумеруются в порядке добавления: лог-файл записывает определения
+// строк, добавленных после начала его сессии, непосредственно перед выводимой записью
+class registry
+{
+public:
+	static constexpr size_t size = 4096;
+
+	static registry& instance();
+
+	// Получение идентификатора строки (0 - реестр заполнен). added = true, если строка добавлена этим вызовом
+	uint32_t intern_fmt(const char *fmt, bool &added);
+	uint32_t intern_module(const std::string &name, bool &added);
+
+	// Число добавленных строк
+	uint32_t count() const { return added_num.load(std::memory_order_acquire); }
+
+	// Добавление в out определений строк с порядковыми номерами [from, to)
+	void dump(log_buf &out, uint32_t from, uint32_t to) const;
+
+	// Добавление в out определений всех зарегистрированных строк. Возвращает число строк
+	uint32_t dump(log_buf &out) const;
+
+	// Запись определения строки с идентификатором id
+	void define(writer &w, uint32_t id) const;
+
+private:
+	struct entry{
+		std::atomic<uint64_t> key{0};
+		std::atomic<const char*> text{nullptr};
+		uint8_t kind = kind_fmt;
+	};
+
+	entry entries[size];
+	uint32_t order[size] = {};				// идентификаторы строк в порядке добавления
+	std::atomic<uint32_t> added_num{0};
+	std::mutex add_mutex;
+
+	uint32_t intern(uint64_t key, uint8_t kind, const char *text, size_t len, bool copy, bool &added);
+};
+
+}
+
+#endif
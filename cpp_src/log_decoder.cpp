@@ -0,0 +1,367 @@
+// Утилита восстановления текста сообщений из бинарного лог-файла (см. Logging::set_binary())
+//
+// Использование: logger-decode [файл...]
+// Без аргументов данные читаются из stdin. Текст выводится в stdout в том же виде,
+// в каком его вывел бы логер в текстовом режиме (структурированные события - строками JSON).
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "logger.hpp"
+
+namespace {
+
+// Чтение бинарного лог-файла
+class reader
+{
+public:
+	reader(const char *buf, size_t len): cur(buf), end(buf + len) {}
+
+	bool ok() const { return good; }
+	bool eof() const { return cur >= end; }
+	size_t pos(const char *base) const { return cur - base; }
+
+	uint8_t u8(){
+		if(cur >= end){ good = false; return 0; }
+		return (uint8_t)*cur++;
+	}
+
+	uint64_t varint(){
+		uint64_t v = 0;
+		for(int shift = 0; shift < 64 && good; shift += 7){
+			uint8_t b = u8();
+			v |= (uint64_t)(b & 0x7F) << shift;
+			if(!(b & 0x80)) break;
+		}
+		return v;
+	}
+
+	int64_t svarint(){
+		uint64_t v = varint();
+		return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+	}
+
+	void bytes(void *dst, size_t len){
+		if((size_t)(end - cur) < len){ good = false; return; }
+		std::memcpy(dst, cur, len);
+		cur += len;
+	}
+
+	// Пропуск нулевого хвоста файла (место, выделенное в режиме отображения и не обрезанное
+	// из-за аварийного завершения процесса). false - после текущей позиции есть данные
+	bool skip_zeros(){
+		const char *p = cur;
+		while(p < end && !*p) ++p;
+		if(p != end) return false;
+		cur = end;
+		return true;
+	}
+
+	std::string str(){
+		size_t len = varint();
+		if((size_t)(end - cur) < len){ good = false; return ""; }
+		std::string s(cur, len);
+		cur += len;
+		return s;
+	}
+
+private:
+	const char *cur;
+	const char *end;
+	bool good = true;
+};
+
+// Значение аргумента сообщения (поле соответствующего типа)
+struct arg_t{
+	uint8_t type = 0;
+	int32_t i32 = 0;
+	int64_t i = 0;
+	uint64_t u = 0;
+	bool b = false;
+	const void *p = nullptr;
+	double d = 0;
+	long double ld = 0;
+	std::string s;
+	uint8_t delim = 0;						// число байт в строке дампа (arg_blob)
+};
+
+// Определения строк сессии
+using strings_t = std::map<uint32_t, std::string>;
+
+// Разобранное сообщение
+struct message_t{
+	size_t session = 0;
+	uint8_t flags = 0;
+	uint8_t stamp_type = 0;
+	uint32_t fmt_id = 0, mod_id = 0, stamp_id = 0;
+	std::string fmt, mod, stamp_fmt;		// строки, записанные непосредственно в сообщении
+	struct timespec spec{};
+	std::vector<arg_t> args;
+	bool event = false;						// структурированное событие: fmt - имя события
+	std::vector<std::string> keys;			// ключи полей события (значения - в args)
+};
+
+// Получение строки по идентификатору (или строки из сообщения при id == 0)
+const std::string& lookup(const strings_t &strs, uint32_t id, const std::string &inl)
+{
+	static const std::string unknown = "<unknown string>";
+	if(!id) return inl;
+
+	auto it = strs.find(id);
+	return (it == strs.end()) ? unknown : it->second;
+}
+
+bool read_arg(reader &r, arg_t &a)
+{
+	a.type = r.u8();
+	switch(a.type){
+		case log_bin::arg_int32: a.i = r.svarint(); a.i32 = (int32_t)a.i; break;
+		case log_bin::arg_int: a.i = r.svarint(); break;
+		case log_bin::arg_uint: a.u = r.varint(); break;
+		case log_bin::arg_ptr: a.p = (const void*)(uintptr_t)r.varint(); break;
+		case log_bin::arg_bool: a.b = r.u8() != 0; break;
+		case log_bin::arg_double: r.bytes(&a.d, sizeof a.d); break;
+		case log_bin::arg_ldouble: r.bytes(&a.ld, sizeof a.ld); break;
+		case log_bin::arg_str: a.s = r.str(); break;
+		case log_bin::arg_blob: a.delim = r.u8(); a.s = r.str(); break;
+		default: return false;
+	}
+	return true;
+}
+
+bool read_message(reader &r, message_t &m)
+{
+	m.flags = r.u8();
+	m.stamp_type = r.u8();
+
+	m.fmt_id = (uint32_t)r.varint();
+	if(!m.fmt_id) m.fmt = r.str();
+	m.mod_id = (uint32_t)r.varint();
+	if(!m.mod_id) m.mod = r.str();
+	if(m.stamp_type == Logging::custom){
+		m.stamp_id = (uint32_t)r.varint();
+		if(!m.stamp_id) m.stamp_fmt = r.str();
+	}
+
+	m.spec.tv_sec = (time_t)r.varint();
+	m.spec.tv_nsec = (long)r.varint();
+
+	uint8_t argc = r.u8();
+	for(uint8_t n = 0; n < argc && r.ok(); ++n){
+		arg_t a;
+		if(!read_arg(r, a)) return false;
+		m.args.push_back(a);
+	}
+
+	return r.ok();
+}
+
+bool read_event(reader &r, message_t &m)
+{
+	m.event = true;
+	m.flags = r.u8();
+
+	m.fmt_id = (uint32_t)r.varint();
+	if(!m.fmt_id) m.fmt = r.str();
+	m.mod_id = (uint32_t)r.varint();
+	if(!m.mod_id) m.mod = r.str();
+
+	m.spec.tv_sec = (time_t)r.varint();
+	m.spec.tv_nsec = (long)r.varint();
+
+	uint8_t fieldc = r.u8();
+	for(uint8_t n = 0; n < fieldc && r.ok(); ++n){
+		m.keys.push_back(r.str());
+		arg_t a;
+		if(!read_arg(r, a)) return false;
+		m.args.push_back(a);
+	}
+
+	return r.ok();
+}
+
+// Восстановление строки JSON события (в том же виде, что и в текстовом режиме)
+std::string format_event(const message_t &m, const std::string &name, const std::string &mod)
+{
+	log_buf out;
+	log_json::put_head(out, m.spec, m.flags & LOG_LVL_BIT_MASK, mod, name);
+
+	for(size_t i = 0; i < m.args.size(); ++i){
+		const arg_t &a = m.args[i];
+		log_json::put_key(out, m.keys[i]);
+
+		switch(a.type){
+			case log_bin::arg_int32:
+			case log_bin::arg_int: log_json::put_int(out, a.i); break;
+			case log_bin::arg_uint: log_json::put_uint(out, a.u); break;
+			case log_bin::arg_bool: log_json::put_bool(out, a.b); break;
+			case log_bin::arg_double: log_json::put_double(out, a.d); break;
+			case log_bin::arg_ldouble: log_json::put_double(out, (double)a.ld); break;
+			case log_bin::arg_str: log_json::put_str(out, a.s); break;
+			case log_bin::arg_blob: {
+				log_buf dump;
+				log_formatter<log_bin::blob>::format(dump, log_bin::blob{reinterpret_cast<const uint8_t*>(a.s.data()), a.s.size(), a.delim});
+				log_json::put_str(out, std::string_view(dump.data(), dump.size()));
+				break;
+			}
+			case log_bin::arg_ptr:
+				if(!a.p) out.append("null", 4);
+				else log_json::put_value(out, a.p);
+				break;
+		}
+	}
+
+	log_json::put_tail(out);
+	return std::string(out.data(), out.size());
+}
+
+// Ссылка на значение аргумента для форматирования логером (blob - место для описания блока дампа)
+log_fmt::arg_ref make_ref(const arg_t &a, log_bin::blob &blob)
+{
+	switch(a.type){
+		case log_bin::arg_blob:
+			blob = log_bin::blob{reinterpret_cast<const uint8_t*>(a.s.data()), a.s.size(), a.delim};
+			return log_fmt::make_arg_ref(blob);
+		case log_bin::arg_int32: return log_fmt::make_arg_ref(a.i32);
+		case log_bin::arg_int: return log_fmt::make_arg_ref(a.i);
+		case log_bin::arg_uint: return log_fmt::make_arg_ref(a.u);
+		case log_bin::arg_bool: return log_fmt::make_arg_ref(a.b);
+		case log_bin::arg_ptr: return log_fmt::make_arg_ref(a.p);
+		case log_bin::arg_double: return log_fmt::make_arg_ref(a.d);
+		case log_bin::arg_ldouble: return log_fmt::make_arg_ref(a.ld);
+		default: return log_fmt::make_arg_ref(a.s);
+	}
+}
+
+// Восстановление текста сообщения по строке формата: форматирование выполняется тем же кодом,
+// что и в текстовом режиме (log_fmt::format_runtime), поэтому текст совпадает с выведенным логером
+std::string format_message(const std::string &fmt, const std::vector<arg_t> &args)
+{
+	std::vector<log_bin::blob> blobs(args.size());
+	std::vector<log_fmt::arg_ref> refs;
+	refs.reserve(args.size() + 1);
+	for(size_t i = 0; i < args.size(); ++i) refs.push_back(make_ref(args[i], blobs[i]));
+	refs.push_back(log_fmt::arg_ref{nullptr, nullptr, nullptr});
+
+	log_buf out;
+	log_fmt::format_runtime(out, fmt.c_str(), refs.data(), args.size());
+	return std::string(out.data(), out.size());
+}
+
+// Декодирование содержимого бинарного лог-файла
+int decode(const std::vector<char> &data, const char *name)
+{
+	reader r(data.data(), data.size());
+	std::vector<strings_t> sessions;
+	std::vector<message_t> messages;
+
+	// Первый проход: определения строк могут следовать за первым сообщением, которое их использует
+	while(!r.eof()){
+		if(r.skip_zeros()) break;
+		uint8_t tag = r.u8();
+
+		if(tag == log_bin::rec_session){
+			char magic[sizeof(log_bin::magic)];
+			r.bytes(magic, sizeof magic);
+			uint8_t ver = r.u8();
+			// Файлы предыдущих версий формата читаются: их типы аргументов - подмножество текущих
+			if(!r.ok() || std::memcmp(magic, log_bin::magic, sizeof magic) || !ver || ver > log_bin::version){
+				std::fprintf(stderr, "%s: unsupported file format\n", name);
+				return 1;
+			}
+			sessions.emplace_back();
+		}
+		else if(tag == log_bin::rec_define && !sessions.empty()){
+			uint32_t id = (uint32_t)r.varint();
+			r.u8();
+			sessions.back()[id] = r.str();
+		}
+		else if(tag == log_bin::rec_message && !sessions.empty()){
+			message_t m;
+			m.session = sessions.size() - 1;
+			if(!read_message(r, m)) break;
+			messages.push_back(std::move(m));
+		}
+		else if(tag == log_bin::rec_event && !sessions.empty()){
+			message_t m;
+			m.session = sessions.size() - 1;
+			if(!read_event(r, m)) break;
+			messages.push_back(std::move(m));
+		}
+		else break;
+
+		if(!r.ok()) break;
+	}
+
+	if(!r.eof()){
+		std::fprintf(stderr, "%s: corrupted record at offset %zu\n", name, r.pos(data.data()));
+	}
+
+	// Второй проход: вывод текста
+	for(const message_t &m : messages){
+		const strings_t &strs = sessions[m.session];
+		const std::string &mod = lookup(strs, m.mod_id, m.mod);
+
+		if(m.event){
+			std::fputs(format_event(m, lookup(strs, m.fmt_id, m.fmt), mod).c_str(), stdout);
+			continue;
+		}
+
+		const std::string &stamp_fmt = lookup(strs, m.stamp_id, m.stamp_fmt);
+
+		char stamp[LOG_STAMP_MAX_LEN];
+		Logging::make_msg_stamp(stamp, sizeof stamp, m.spec, (Logging::stamp_t)m.stamp_type, mod, stamp_fmt.c_str());
+
+		std::fputs(stamp, stdout);
+		std::fputs(format_message(lookup(strs, m.fmt_id, m.fmt), m.args).c_str(), stdout);
+	}
+
+	return r.eof() ? 0 : 1;
+}
+
+bool read_all(std::FILE *fp, std::vector<char> &data)
+{
+	char buf[65536];
+	size_t n;
+	while((n = std::fread(buf, 1, sizeof buf, fp)) > 0) data.insert(data.end(), buf, buf + n);
+
+	return !std::ferror(fp);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	int ret = 0;
+
+	if(argc < 2){
+		std::vector<char> data;
+		if(!read_all(stdin, data)) return 1;
+		return decode(data, "stdin");
+	}
+
+	for(int i = 1; i < argc; ++i){
+		if(!std::strcmp(argv[i], "-h") || !std::strcmp(argv[i], "--help")){
+			std::printf("Usage: %s [file...]\n", argv[0]);
+			return 0;
+		}
+
+		std::FILE *fp = std::fopen(argv[i], "rb");
+		if(!fp){
+			std::fprintf(stderr, "%s: %s\n", argv[i], std::strerror(errno));
+			ret = 1;
+			continue;
+		}
+
+		std::vector<char> data;
+		if(!read_all(fp, data)) ret = 1;
+		std::fclose(fp);
+
+		ret |= decode(data, argv[i]);
+	}
+
+	return ret;
+}
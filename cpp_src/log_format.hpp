@@ -0,0 +1,525 @@
+#ifndef _LOG_FORMAT_HPP
+#define _LOG_FORMAT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <memory>
+#include <utility>
+#include <charconv>
+#include <type_traits>
+#include <string_view>
+
+// Размер встроенного буфера записи (до его заполнения динамическая память не выделяется) [Байт]
+#define LOG_BUF_INLINE_SIZE		512
+
+// Буфер формирования записи лога
+class log_buf
+{
+public:
+	log_buf() = default;
+	log_buf(const log_buf&) = delete;
+	log_buf& operator=(const log_buf&) = delete;
+
+	const char* data() const { return mem ? mem.get() : local; }
+	size_t size() const { return len; }
+	bool empty() const { return !len; }
+	void clear() { len = 0; }
+
+	// Обрезка записи до длины n
+	void truncate(size_t n) { if(n < len) len = n; }
+
+	void append(const char *s, size_t n){
+		std::memcpy(tail(n), s, n);
+		len += n;
+	}
+	void append(const char *s) { append(s, std::strlen(s)); }
+	void append(const std::string &s) { append(s.data(), s.size()); }
+	void append(size_t n, char c){
+		std::memset(tail(n), c, n);
+		len += n;
+	}
+	void push_back(char c) { *tail(1) = c; ++len; }
+
+	// Получение места под n Байт в конце буфера. Записанное фиксируется вызовом commit()
+	char* tail(size_t n){
+		if(len + n > capacity()) grow(len + n);
+		return buf() + len;
+	}
+	void commit(size_t n) { len += n; }
+
+	// Вставка n символов c в позицию pos (выравнивание по ширине поля)
+	void insert(size_t pos, size_t n, char c){
+		tail(n);
+		std::memmove(buf() + pos + n, buf() + pos, len - pos);
+		std::memset(buf() + pos, c, n);
+		len += n;
+	}
+
+private:
+	char local[LOG_BUF_INLINE_SIZE];
+	std::unique_ptr<char[]> mem;
+	size_t cap = 0;
+	size_t len = 0;
+
+	char* buf() { return mem ? mem.get() : local; }
+	size_t capacity() const { return mem ? cap : sizeof local; }
+
+	void grow(size_t need){
+		size_t new_cap = capacity() * 2;
+		while(new_cap < need) new_cap *= 2;
+
+		char *p = new char[new_cap];
+		std::memcpy(p, data(), len);
+		mem.reset(p);
+		cap = new_cap;
+	}
+};
+
+// Пользовательские типы подключаются к форматированию специализацией:
+//	template<> struct log_formatter<my_type>{
+//		static void format(log_buf &out, const my_type &v);
+//	};
+// и выводятся по спецификатору %s
+template<typename T, typename = void>
+struct log_formatter;
+
+// Форматирование сообщений в стиле printf без использования printf.
+// Для строк формата, заданных через LOG_FMT("..."), разбор и проверка соответствия
+// спецификаторов типам аргументов выполняются при компиляции.
+// Модификаторы длины (h, l, ll, z и т.п.) допускаются и игнорируются - тип известен из аргумента
+namespace log_fmt {
+
+// Спецификатор преобразования
+struct spec_t{
+	char conv = 0;			// символ преобразования: d i u o x X c s f F e E g G a A p
+	bool left = false;		// '-'
+	bool plus = false;		// '+'
+	bool space = false;		// ' '
+	bool alt = false;		// '#'
+	bool zero = false;		// '0'
+	bool star_width = false;// ширина задается аргументом ('*')
+	bool star_prec = false;	// точность задается аргументом ('.*')
+	int width = -1;
+	int prec = -1;
+};
+
+constexpr bool is_int_conv(char c) { return c == 'd' || c == 'i' || c == 'u' || c == 'o' || c == 'x' || c == 'X' || c == 'c'; }
+constexpr bool is_float_conv(char c) { return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A'; }
+constexpr bool is_conv(char c) { return is_int_conv(c) || is_float_conv(c) || c == 's' || c == 'p'; }
+
+// Разбор спецификатора, начинающегося после '%' в позиции i. Возвращает позицию после спецификатора или 0 при ошибке
+constexpr size_t parse_spec(const char *s, size_t i, spec_t &sp)
+{
+	for(;; ++i){
+		if(s[i] == '-') sp.left = true;
+		else if(s[i] == '+') sp.plus = true;
+		else if(s[i] == ' ') sp.space = true;
+		else if(s[i] == '#') sp.alt = true;
+		else if(s[i] == '0') sp.zero = true;
+		else break;
+	}
+
+	if(s[i] == '*'){ sp.star_width = true; ++i; }
+	else if(s[i] >= '1' && s[i] <= '9'){
+		sp.width = 0;
+		while(s[i] >= '0' && s[i] <= '9') sp.width = sp.width * 10 + (s[i++] - '0');
+	}
+
+	if(s[i] == '.'){
+		++i;
+		if(s[i] == '*'){ sp.star_prec = true; ++i; }
+		else{
+			sp.prec = 0;
+			while(s[i] >= '0' && s[i] <= '9') sp.prec = sp.prec * 10 + (s[i++] - '0');
+		}
+	}
+
+	while(s[i] == 'h' || s[i] == 'l' || s[i] == 'L' || s[i] == 'q' || s[i] == 'j' || s[i] == 'z' || s[i] == 't') ++i;
+
+	if(!is_conv(s[i])) return 0;
+	sp.conv = s[i];
+	return i + 1;
+}
+
+constexpr size_t cstr_len(const char *s)
+{
+	size_t n = 0;
+	while(s[n]) ++n;
+	return n;
+}
+
+constexpr size_t count_percent(const char *s)
+{
+	size_t n = 0;
+	for(size_t i = 0; s[i]; ++i) if(s[i] == '%') ++n;
+	return n;
+}
+
+// Разобранная строка формата: текст без спецификаторов ('%%' заменено на '%')
+// и спецификаторы с позициями их вставки в текст
+template<size_t L, size_t N>
+struct parsed{
+	char text[L + 1] = {};
+	size_t text_len = 0;
+	spec_t specs[N + 1] = {};
+	size_t pos[N + 1] = {};
+	size_t nspecs = 0;
+	bool valid = true;
+	bool has_star = false;
+};
+
+template<size_t L, size_t N>
+constexpr parsed<L, N> parse(const char *s)
+{
+	parsed<L, N> p{};
+
+	for(size_t i = 0; s[i]; ){
+		if(s[i] != '%'){ p.text[p.text_len++] = s[i++]; continue; }
+
+		if(s[i + 1] == '%'){ p.text[p.text_len++] = '%'; i += 2; continue; }
+
+		spec_t sp{};
+		size_t next = parse_spec(s, i + 1, sp);
+		if(!next){ p.valid = false; return p; }
+		if(sp.star_width || sp.star_prec) p.has_star = true;
+
+		p.specs[p.nspecs] = sp;
+		p.pos[p.nspecs] = p.text_len;
+		++p.nspecs;
+		i = next;
+	}
+
+	return p;
+}
+
+// Признак строки формата, заданной через LOG_FMT()
+struct fmt_string{};
+
+template<typename F>
+struct is_fmt_string: std::is_base_of<fmt_string, F> {};
+
+// Строка формата, разобранная при компиляции
+template<typename F>
+struct compiled{
+	static constexpr size_t len = cstr_len(F::str());
+	static constexpr auto p = parse<len, count_percent(F::str())>(F::str());
+};
+
+// Наличие пользовательского форматирования log_formatter<T>
+template<typename T, typename = void>
+struct has_formatter: std::false_type {};
+
+template<typename T>
+struct has_formatter<T, decltype(log_formatter<T>::format(std::declval<log_buf&>(), std::declval<const T&>()), void())>: std::true_type {};
+
+template<typename T>
+using arg_type = typename std::decay<T>::type;
+
+template<typename T>
+struct is_cstr: std::integral_constant<bool, std::is_same<arg_type<T>, const char*>::value || std::is_same<arg_type<T>, char*>::value> {};
+
+template<typename T>
+struct is_string: std::integral_constant<bool, std::is_same<arg_type<T>, std::string>::value || std::is_same<arg_type<T>, std::string_view>::value> {};
+
+// Проверка допустимости спецификатора conv для аргумента типа T
+template<typename T>
+constexpr bool accepts(char conv)
+{
+	using U = arg_type<T>;
+
+	if(std::is_same<U, bool>::value) return conv == 's' || conv == 'd' || conv == 'i' || conv == 'u';
+	if(std::is_integral<U>::value || std::is_enum<U>::value) return is_int_conv(conv);
+	if(std::is_floating_point<U>::value) return is_float_conv(conv);
+	if(is_cstr<T>::value) return conv == 's' || conv == 'p';
+	if(is_string<T>::value) return conv == 's';
+	if(std::is_pointer<U>::value || std::is_null_pointer<U>::value) return conv == 'p';
+	if(has_formatter<U>::value) return conv == 's';
+
+	return false;
+}
+
+template<typename P, typename... Args, size_t... I>
+constexpr bool check_args(const P &p, std::index_sequence<I...>)
+{
+	bool ok = true;
+	bool res[] = {true, accepts<Args>(I < p.nspecs ? p.specs[I].conv : 0)...};
+	for(bool r : res) ok = ok && r;
+	return ok;
+}
+
+// Вывод с выравниванием по ширине поля: значение уже записано в out начиная с позиции start
+inline void pad(log_buf &out, const spec_t &sp, size_t start, size_t zero_pos = (size_t)-1)
+{
+	size_t n = out.size() - start;
+	if(sp.width < 0 || (size_t)sp.width <= n) return;
+
+	size_t fill = sp.width - n;
+	if(sp.left) out.append(fill, ' ');
+	else if(sp.zero && zero_pos != (size_t)-1) out.insert(zero_pos, fill, '0');
+	else out.insert(start, fill, ' ');
+}
+
+inline void put_str(log_buf &out, const spec_t &sp, const char *s, size_t n)
+{
+	if(sp.prec >= 0 && (size_t)sp.prec < n) n = sp.prec;
+
+	size_t start = out.size();
+	out.append(s, n);
+	pad(out, sp, start);
+}
+
+inline void put_integer(log_buf &out, const spec_t &sp, uint64_t mag, bool neg)
+{
+	size_t start = out.size();
+
+	if(sp.conv == 'c'){
+		out.push_back((char)mag);
+		pad(out, sp, start);
+		return;
+	}
+
+	if(neg) out.push_back('-');
+	else if(sp.plus && (sp.conv == 'd' || sp.conv == 'i')) out.push_back('+');
+	else if(sp.space && (sp.conv == 'd' || sp.conv == 'i')) out.push_back(' ');
+
+	int base = 10;
+	if(sp.conv == 'o') base = 8;
+	else if(sp.conv == 'x' || sp.conv == 'X') base = 16;
+
+	if(sp.alt && base == 16 && mag) out.append(sp.conv == 'X' ? "0X" : "0x", 2);
+
+	char digits[24];
+	size_t n = 0;
+	if(mag || sp.prec != 0) n = std::to_chars(digits, digits + sizeof digits, mag, base).ptr - digits;
+	if(sp.conv == 'X') for(size_t i = 0; i < n; ++i) if(digits[i] >= 'a') digits[i] -= 'a' - 'A';
+	if(sp.alt && base == 8 && (!n || digits[0] != '0')) out.push_back('0');
+
+	size_t zero_pos = out.size();
+	if(sp.prec > 0 && (size_t)sp.prec > n) out.append(sp.prec - n, '0');
+	out.append(digits, n);
+
+	pad(out, sp, start, sp.prec < 0 ? zero_pos : (size_t)-1);
+}
+
+template<typename F>
+inline void put_float(log_buf &out, const spec_t &sp, F v)
+{
+	std::chars_format cf = std::chars_format::fixed;
+	switch(sp.conv){
+		case 'e': case 'E': cf = std::chars_format::scientific; break;
+		case 'g': case 'G': cf = std::chars_format::general; break;
+		case 'a': case 'A': cf = std::chars_format::hex; break;
+		default: break;
+	}
+
+	int prec = (sp.prec > 100) ? 100 : sp.prec;
+	if(prec < 0 && cf != std::chars_format::hex) prec = 6;
+	if(cf == std::chars_format::general && prec == 0) prec = 1;
+
+	char tmp[512];
+	std::to_chars_result r = (prec < 0) ? std::to_chars(tmp, tmp + sizeof tmp, v, cf)
+										: std::to_chars(tmp, tmp + sizeof tmp, v, cf, prec);
+	size_t n = (r.ec == std::errc()) ? r.ptr - tmp : 0;
+
+	char *d = tmp;
+	bool neg = (n && d[0] == '-');
+	if(neg){ ++d; --n; }
+
+	// '#' для %g: десятичная точка и незначащие нули сохраняются (to_chars их отбрасывает)
+	if(sp.alt && cf == std::chars_format::general && n && d[0] >= '0' && d[0] <= '9'){
+		size_t mant = 0, sig = 0;
+		bool dot = false, lead = true;
+		for(; mant < n && d[mant] != 'e'; ++mant){
+			if(d[mant] == '.'){ dot = true; continue; }
+			if(d[mant] != '0') lead = false;
+			if(!lead) ++sig;
+		}
+		size_t add = (size_t)prec > sig ? (size_t)prec - (sig ? sig : 1) : 0;
+		size_t ins = (dot ? 0 : 1) + add;
+		if(ins && n + ins < sizeof tmp - (d - tmp)){
+			std::memmove(d + mant + ins, d + mant, n - mant);
+			if(!dot) d[mant++] = '.';
+			std::memset(d + mant, '0', add);
+			n += ins;
+		}
+	}
+
+	if(sp.conv == 'F' || sp.conv == 'E' || sp.conv == 'G' || sp.conv == 'A'){
+		for(size_t i = 0; i < n; ++i) if(d[i] >= 'a' && d[i] <= 'z') d[i] -= 'a' - 'A';
+	}
+
+	size_t start = out.size();
+	if(neg) out.push_back('-');
+	else if(sp.plus) out.push_back('+');
+	else if(sp.space) out.push_back(' ');
+	if(cf == std::chars_format::hex) out.append(sp.conv == 'A' ? "0X" : "0x", 2);
+
+	// Дополнение нулями выполняется после знака и префикса (кроме inf и nan)
+	size_t zero_pos = out.size();
+	out.append(d, n);
+	pad(out, sp, start, std::isfinite(v) ? zero_pos : (size_t)-1);
+}
+
+inline void put_ptr(log_buf &out, const spec_t &sp, const void *p)
+{
+	size_t start = out.size();
+
+	if(!p) out.append("(nil)", 5);
+	else{
+		out.append("0x", 2);
+		char digits[24];
+		size_t n = std::to_chars(digits, digits + sizeof digits, (uintptr_t)p, 16).ptr - digits;
+		out.append(digits, n);
+	}
+
+	pad(out, sp, start);
+}
+
+// Тип целого аргумента после продвижения (перечисления - по базовому типу)
+template<typename T, bool = std::is_enum<T>::value>
+struct promoted{
+	using type = decltype(+std::declval<T>());
+};
+
+template<typename T>
+struct promoted<T, true>{
+	using type = typename promoted<typename std::underlying_type<T>::type>::type;
+};
+
+// Вывод аргумента по спецификатору
+template<typename T>
+inline void put_arg(log_buf &out, const spec_t &sp, const T &v)
+{
+	using U = arg_type<T>;
+
+	if constexpr (std::is_same<U, bool>::value){
+		if(sp.conv == 's') put_str(out, sp, v ? "True" : "False", v ? 4 : 5);
+		else put_integer(out, sp, v ? 1 : 0, false);
+	}
+	else if constexpr (std::is_integral<U>::value || std::is_enum<U>::value){
+		// Целочисленное продвижение как при передаче аргумента в printf
+		using P = typename promoted<U>::type;
+		P pv = static_cast<P>(v);
+
+		if(is_float_conv(sp.conv)) put_float(out, sp, (double)pv);
+		else if constexpr (std::is_signed<P>::value){
+			if(pv < 0 && (sp.conv == 'd' || sp.conv == 'i' || sp.conv == 's'))
+				put_integer(out, sp, (uint64_t)0 - (uint64_t)(int64_t)pv, true);
+			else
+				put_integer(out, sp, (uint64_t)static_cast<typename std::make_unsigned<P>::type>(pv), false);
+		}
+		else put_integer(out, sp, (uint64_t)pv, false);
+	}
+	else if constexpr (std::is_floating_point<U>::value){
+		if(is_float_conv(sp.conv)) put_float(out, sp, v);
+		else{
+			spec_t f = sp;
+			f.conv = 'f';
+			put_float(out, f, v);
+		}
+	}
+	else if constexpr (is_cstr<T>::value){
+		const char *s = v;
+		if(sp.conv == 'p') put_ptr(out, sp, s);
+		else if(!s) put_str(out, sp, "(null)", 6);
+		else put_str(out, sp, s, std::strlen(s));
+	}
+	else if constexpr (is_string<T>::value){
+		put_str(out, sp, v.data(), v.size());
+	}
+	else if constexpr (std::is_pointer<U>::value || std::is_null_pointer<U>::value){
+		put_ptr(out, sp, (const void*)v);
+	}
+	else if constexpr (has_formatter<U>::value){
+		size_t start = out.size();
+		log_formatter<U>::format(out, v);
+		pad(out, sp, start);
+	}
+	else{
+		static_assert(has_formatter<U>::value, "log format: argument type is not printable, specialize log_formatter<T>");
+	}
+}
+
+// Значение аргумента для ширины или точности '*'
+template<typename T>
+inline int as_int(const T &v)
+{
+	using U = arg_type<T>;
+	if constexpr (std::is_integral<U>::value || std::is_enum<U>::value) return (int)v;
+	else return 0;
+}
+
+// Форматирование по строке формата, разобранной при компиляции
+template<typename P, typename... Args, size_t... I>
+inline void format_compiled(log_buf &out, const P &p, std::index_sequence<I...>, const Args&... args)
+{
+	size_t prev = 0;
+	int expand[] = {0, (
+		out.append(&p.text[prev], p.pos[I] - prev),
+		put_arg(out, p.specs[I], args),
+		prev = p.pos[I], 0)...};
+	(void)expand;
+
+	out.append(&p.text[prev], p.text_len - prev);
+}
+
+template<typename F, typename... Args>
+inline typename std::enable_if<is_fmt_string<F>::value>::type
+format(log_buf &out, F, const Args&... args)
+{
+	constexpr auto &p = compiled<F>::p;
+
+	static_assert(p.valid, "log format: invalid conversion specifier in format string");
+	static_assert(!p.has_star, "log format: '*' width/precision is not supported in LOG_FMT format strings");
+	static_assert(p.nspecs == sizeof...(Args), "log format: number of arguments does not match format string");
+	static_assert(check_args<decltype(p), Args...>(p, std::index_sequence_for<Args...>{}),
+		"log format: conversion specifier does not match argument type");
+
+	format_compiled(out, p, std::index_sequence_for<Args...>{}, args...);
+}
+
+// Ссылка на аргумент с типом, известным только во время выполнения
+struct arg_ref{
+	void (*put)(log_buf&, const spec_t&, const void*);
+	int (*to_int)(const void*);
+	const void *ptr;
+};
+
+template<typename T>
+inline arg_ref make_arg_ref(const T &v)
+{
+	return arg_ref{
+		[](log_buf &out, const spec_t &sp, const void *p){ put_arg(out, sp, *static_cast<const T*>(p)); },
+		[](const void *p){ return as_int(*static_cast<const T*>(p)); },
+		&v
+	};
+}
+
+// Форматирование по строке формата, разбираемой во время выполнения
+void format_runtime(log_buf &out, const char *fmt, const arg_ref *args, size_t nargs);
+
+template<typename... Args>
+inline void format(log_buf &out, const char *fmt, const Args&... args)
+{
+	const arg_ref refs[] = {make_arg_ref(args)..., arg_ref{nullptr, nullptr, nullptr}};
+	format_runtime(out, fmt ? fmt : "(null)", refs, sizeof...(Args));
+}
+
+
+// Строка std::string выводится без разбора (как неформатированный текст)
+inline void format(log_buf &out, const std::string &s) { out.append(s); }
+
+}
+
+// Строка формата, разбираемая и проверяемая при компиляции:
+//	logger.msg(MSG_DEBUG, LOG_FMT("x = %d, name = %s\n"), x, name);
+#define LOG_FMT(s) ([]{ 											\
+	struct log_fmt_str: log_fmt::fmt_string { 						\
+		static constexpr const char* str() { return s; } 			\
+	}; 																\
+	return log_fmt_str{}; 											\
+}())
+
+#endif
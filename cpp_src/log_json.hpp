@@ -0,0 +1,195 @@
+#ifndef _LOG_JSON_HPP
+#define _LOG_JSON_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <charconv>
+#include <type_traits>
+#include <string_view>
+
+#include "log_format.hpp"
+
+// Кодирование структурированных событий в формате JSON-lines (одна строка - один объект):
+//	{"ts":1618927992.153021,"lvl":"info","mod":"APP","event":"conn_closed","fd":5,"bytes":1024}
+// Значения записываются по типу: целые и вещественные - числами (inf и nan - null), bool - true/false,
+// строки - с экранированием, пользовательские типы (log_formatter) - строкой
+namespace log_json {
+
+// Имена уровней сообщений (по индексу уровня)
+constexpr const char* lvl_names[] = {"none", "error", "warning", "info", "debug", "verbose", "trace"};
+
+constexpr bool needs_escape(unsigned char c) { return c < 0x20 || c == '"' || c == '\\'; }
+
+// Длина начального участка строки, не требующего экранирования. Строка проверяется
+// по 8 Байт за шаг (признаки байт < 0x20, '"' и '\\' вычисляются для всего слова)
+inline size_t clean_prefix(const char *s, size_t n)
+{
+	constexpr uint64_t ones = 0x0101010101010101ull;
+	constexpr uint64_t high = 0x8080808080808080ull;
+
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		uint64_t w;
+		std::memcpy(&w, s + i, 8);
+		uint64_t q = w ^ (ones * '"');
+		uint64_t b = w ^ (ones * '\\');
+		uint64_t hit = ((w - ones * 0x20) & ~w) | ((q - ones) & ~q) | ((b - ones) & ~b);
+		if(hit & high) break;
+	}
+	while(i < n && !needs_escape((unsigned char)s[i])) ++i;
+
+	return i;
+}
+
+// Строка в кавычках с экранированием. Участки без спецсимволов копируются целиком
+inline void put_str(log_buf &out, const char *s, size_t n)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	// Место с запасом на худший случай (\u00XX для каждого символа)
+	char *beg = out.tail(n * 6 + 2);
+	char *p = beg;
+
+	*p++ = '"';
+	while(n){
+		size_t k = clean_prefix(s, n);
+		std::memcpy(p, s, k);
+		p += k;
+		s += k;
+		n -= k;
+		if(!n) break;
+
+		unsigned char c = (unsigned char)*s++;
+		--n;
+		*p++ = '\\';
+		switch(c){
+			case '"': *p++ = '"'; break;
+			case '\\': *p++ = '\\'; break;
+			case '\n': *p++ = 'n'; break;
+			case '\r': *p++ = 'r'; break;
+			case '\t': *p++ = 't'; break;
+			case '\b': *p++ = 'b'; break;
+			case '\f': *p++ = 'f'; break;
+			default:
+				std::memcpy(p, "u00", 3);
+				p[3] = hex[c >> 4];
+				p[4] = hex[c & 0x0F];
+				p += 5;
+				break;
+		}
+	}
+	*p++ = '"';
+
+	out.commit(p - beg);
+}
+
+inline void put_str(log_buf &out, std::string_view s) { put_str(out, s.data(), s.size()); }
+
+inline void put_int(log_buf &out, int64_t v)
+{
+	char *p = out.tail(24);
+	out.commit(std::to_chars(p, p + 24, v).ptr - p);
+}
+
+inline void put_uint(log_buf &out, uint64_t v)
+{
+	char *p = out.tail(24);
+	out.commit(std::to_chars(p, p + 24, v).ptr - p);
+}
+
+// Вещественное число в кратчайшей точной записи (inf и nan в JSON не представимы)
+inline void put_double(log_buf &out, double v)
+{
+	if(!std::isfinite(v)){ out.append("null", 4); return; }
+
+	char *p = out.tail(32);
+	out.commit(std::to_chars(p, p + 32, v).ptr - p);
+}
+
+inline void put_bool(log_buf &out, bool v) { v ? out.append("true", 4) : out.append("false", 5); }
+
+// Значение поля по его типу
+template<typename T>
+inline void put_value(log_buf &out, const T &v)
+{
+	using U = log_fmt::arg_type<T>;
+
+	if constexpr (std::is_same<U, bool>::value) put_bool(out, v);
+	else if constexpr (std::is_integral<U>::value || std::is_enum<U>::value){
+		if constexpr (std::is_signed<typename log_fmt::promoted<U>::type>::value) put_int(out, (int64_t)v);
+		else put_uint(out, (uint64_t)v);
+	}
+	else if constexpr (std::is_floating_point<U>::value) put_double(out, (double)v);
+	else if constexpr (log_fmt::is_cstr<T>::value){
+		const char *s = v;
+		if(!s) out.append("null", 4);
+		else put_str(out, s, std::strlen(s));
+	}
+	else if constexpr (log_fmt::is_string<T>::value) put_str(out, v.data(), v.size());
+	else if constexpr (std::is_null_pointer<U>::value) out.append("null", 4);
+	else if constexpr (std::is_pointer<U>::value){
+		char buf[24] = "0x";
+		size_t n = std::to_chars(buf + 2, buf + sizeof buf, (uintptr_t)v, 16).ptr - buf;
+		put_str(out, buf, n);
+	}
+	else if constexpr (log_fmt::has_formatter<U>::value){
+		log_buf text;
+		log_formatter<U>::format(text, v);
+		put_str(out, text.data(), text.size());
+	}
+	else{
+		static_assert(log_fmt::has_formatter<U>::value, "log event: field type is not supported, specialize log_formatter<T>");
+	}
+}
+
+// Имя модуля без обрамления из штампа сообщения ("[ APP ]" -> "APP")
+inline std::string_view module(std::string_view mod)
+{
+	while(!mod.empty() && (mod.front() == '[' || mod.front() == ' ')) mod.remove_prefix(1);
+	while(!mod.empty() && (mod.back() == ']' || mod.back() == ' ')) mod.remove_suffix(1);
+	return mod;
+}
+
+// Начало объекта события: время (секунды с точностью до мкс), уровень, модуль и имя события
+inline void put_head(log_buf &out, const struct timespec &spec, uint8_t lvl, std::string_view mod, std::string_view name)
+{
+	char *p = out.tail(48);
+	char *beg = p;
+	std::memcpy(p, "{\"ts\":", 6);
+	p = std::to_chars(p + 6, p + 32, (int64_t)spec.tv_sec).ptr;
+	*p++ = '.';
+	uint32_t us = (uint32_t)(spec.tv_nsec / 1000);
+	for(int i = 5; i >= 0; --i, us /= 10) p[i] = (char)('0' + us % 10);
+	p += 6;
+	out.commit(p - beg);
+
+	out.append(",\"lvl\":\"", 8);
+	out.append(lvl < sizeof lvl_names / sizeof lvl_names[0] ? lvl_names[lvl] : "none");
+	out.push_back('"');
+
+	mod = module(mod);
+	if(!mod.empty()){
+		out.append(",\"mod\":", 7);
+		put_str(out, mod);
+	}
+
+	out.append(",\"event\":", 9);
+	put_str(out, name);
+}
+
+// Разделитель и ключ очередного поля
+inline void put_key(log_buf &out, std::string_view key)
+{
+	out.push_back(',');
+	put_str(out, key);
+	out.push_back(':');
+}
+
+// Завершение объекта события
+inline void put_tail(log_buf &out) { out.append("}\n", 2); }
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef _LOG_LIMIT_HPP
+#define _LOG_LIMIT_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+
+// Ограничение частоты вывода в месте вызова. Объект размещается макросом в статической памяти
+// (инициализируется при компиляции), решение о пропуске записи принимается одной-двумя
+// атомарными операциями - без блокировок и форматирования.
+// Число пропущенных записей сообщается следующей выведенной записью этого места вызова (см. take())
+class log_limit
+{
+public:
+	constexpr log_limit() = default;
+
+	// Каждая n-я запись (первая выводится)
+	bool every_n(uint64_t n) { return pass(n <= 1 || count.fetch_add(1, std::memory_order_relaxed) % n == 0); }
+
+	// Только первые n записей
+	bool first_n(uint64_t n) { return pass(count.load(std::memory_order_relaxed) < n && count.fetch_add(1, std::memory_order_relaxed) < n); }
+
+	// Не чаще одной записи за ms миллисекунд (время - по грубым часам, с разрешением системного таймера)
+	bool every_ms(uint64_t ms)
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+		int64_t now = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+		int64_t prev = last.load(std::memory_order_relaxed);
+
+		bool ok = (prev < 0 || now - prev >= (int64_t)ms) && last.compare_exchange_strong(prev, now, std::memory_order_relaxed);
+		return pass(ok);
+	}
+
+	// Случайная выборка: запись выводится с вероятностью p
+	bool sampled(double p)
+	{
+		// xorshift32 - свой у каждого потока
+		static thread_local uint32_t state = 2463534242u;
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return pass(state < p * 4294967296.0);
+	}
+
+	// Число записей, пропущенных после последнего вывода (счетчик сбрасывается)
+	uint64_t take_suppressed() { return suppressed.exchange(0, std::memory_order_relaxed); }
+
+	// Число пропущенных записей ограничения owner, ожидающее вывода записи потоком
+	struct pending_t{
+		uint64_t n = 0;
+		const log_limit *owner = nullptr;
+	};
+
+	static pending_t& pending()
+	{
+		static thread_local pending_t p;
+		return p;
+	}
+
+	// Получение числа пропущенных записей записью места вызова, находящегося внутри ограничения limit
+	// (см. log_site::limit; nullptr - запись без места вызова, например msg()). Число передается
+	// один раз и только записи ограничиваемого места вызова: записи других мест вызова
+	// (в том числе выведенные при вычислении аргументов) его не получают
+	static uint64_t take(const log_limit *limit)
+	{
+		pending_t &p = pending();
+		if(!p.n || (limit && limit != p.owner)) return 0;
+
+		uint64_t n = p.n;
+		p.n = 0;
+		return n;
+	}
+
+	// Передача числа пропущенных записей выводимой записи на время ее формирования
+	class report
+	{
+	public:
+		explicit report(log_limit &l) { pending() = pending_t{l.take_suppressed(), &l}; }
+		~report() { pending().n = 0; }
+	};
+
+	// Приостановка передачи на время вывода записей, формируемых логером по своей инициативе
+	// (сообщения о потерях, ротации)
+	class hold
+	{
+	public:
+		hold(): saved(pending().n) { pending().n = 0; }
+		~hold() { pending().n = saved; }
+
+	private:
+		uint64_t saved;
+	};
+
+private:
+	std::atomic<uint64_t> count{0};
+	std::atomic<uint64_t> suppressed{0};
+	std::atomic<int64_t> last{-1};			// время последнего вывода [мс]
+
+	bool pass(bool ok)
+	{
+		if(!ok) suppressed.fetch_add(1, std::memory_order_relaxed);
+		return ok;
+	}
+};
+
+// Ограничение, на которое ссылаются места вызова вне LOG_LIMITED (не ограничивает вывод).
+// Внутри LOG_LIMITED имя перекрывается ограничением места вызова - описатель места вызова
+// (см. LOG_SITE) ссылается на ближайшее охватывающее ограничение
+inline log_limit log_site_limit;
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _LOG_MODULE_HPP
+#define _LOG_MODULE_HPP
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <functional>
+
+// Уровень сообщения для вывода (совпадает с объявлением в logger.hpp)
+using log_lvl_t = uint8_t;
+
+// Модуль логирования (LOG_MODULE_NAME): имя источника для штампа сообщений и собственный уровень.
+// Модули хранятся в общем для процесса реестре и не удаляются - ссылка на модуль действительна
+// до завершения процесса. Макросы логирования получают модуль единицы трансляции один раз
+// и передают его с каждой записью, общее состояние логера при этом не изменяется
+class log_module
+{
+public:
+	// Уровень модуля не задан - действует уровень логера
+	static constexpr log_lvl_t lvl_inherit = 0xFF;
+
+	log_module(const log_module&) = delete;
+	log_module& operator=(const log_module&) = delete;
+
+	const std::string& name() const { return mod_name; }
+
+	// Уровень модуля (без блокировки)
+	log_lvl_t get_lvl() const { return lvl.load(std::memory_order_relaxed); }
+	void set_lvl(log_lvl_t new_lvl) { lvl.store(new_lvl, std::memory_order_relaxed); }
+
+	// Действующий уровень: уровень модуля или уровень логера curr_lvl, если уровень модуля не задан
+	log_lvl_t lvl_or(log_lvl_t curr_lvl) const {
+		log_lvl_t l = get_lvl();
+		return (l == lvl_inherit) ? curr_lvl : l;
+	}
+
+	// Получение модуля по имени (регистрация при первом обращении, выполняется под блокировкой реестра).
+	// Уровень может быть задан до подключения модуля: log_module::get("[ NET ]").set_lvl(MSG_DEBUG)
+	static log_module& get(const std::string &name);
+
+	// Поиск зарегистрированного модуля (nullptr - модуль не зарегистрирован)
+	static log_module* find(const std::string &name);
+
+	// Обход всех зарегистрированных модулей
+	static void for_each(const std::function<void(log_module&)> &fn);
+
+private:
+	explicit log_module(const std::string &name): mod_name(name) {}
+
+	const std::string mod_name;
+	std::atomic<log_lvl_t> lvl{lvl_inherit};
+};
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef _LOG_QUEUE_HPP
+#define _LOG_QUEUE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Ограниченная кольцевая очередь записей лога: много производителей - один потребитель (MPSC).
+// Запись занимает одну или несколько подряд идущих ячеек фиксированного размера.
+// Каждая ячейка имеет счетчик последовательности (схема Д. Вьюкова):
+//	seq == pos 			- ячейка свободна для записи на позиции pos
+//	seq == pos + 1 		- запись на позиции pos опубликована производителем
+//	seq == pos + size 	- ячейка освобождена потребителем для следующего круга
+class log_ring
+{
+public:
+	// Размер ячейки кольцевого буфера [Байт]
+	static constexpr size_t cell_size = 64;
+
+	// Заголовок записи, располагается в начале первой ячейки
+	struct header{
+		uint32_t len;		// длина данных записи [Байт]
+		uint8_t dest;		// назначение записи (битовая маска, определяется пользователем очереди)
+		uint8_t reserved[3];
+	};
+
+	// size_bytes округляется вверх до степени двойки ячеек. Буфер сборки записей, переходящих
+	// через конец кольца, выделяется заранее на максимальную длину записи - извлечение записи
+	// не выделяет память
+	explicit log_ring(size_t size_bytes)
+	{
+		size_t n = 2;
+		while(n * cell_size < size_bytes) n <<= 1;
+
+		cells_num = n;
+		mask = n - 1;
+		data.reset(new char[n * cell_size]);
+		seqs.reset(new std::atomic<uint64_t>[n]);
+		for(size_t i = 0; i < n; ++i) seqs[i].store(i, std::memory_order_relaxed);
+		scratch.reset(new char[max_record()]);
+	}
+
+	log_ring(const log_ring&) = delete;
+	log_ring& operator=(const log_ring&) = delete;
+
+	// Максимальная длина данных одной записи [Байт]
+	size_t max_record() const { return cells_num * cell_size - sizeof(header); }
+
+	// Фрагмент записи, помещаемой в очередь по частям
+	struct part{
+		const char *buf;
+		size_t len;
+	};
+
+	// Помещение записи в очередь (потокобезопасно). false - в очереди нет места
+	bool try_push(uint8_t dest, const char *buf, size_t len)
+	{
+		part p{buf, len};
+		return try_push(dest, &p, 1);
+	}
+
+	// Помещение записи, составленной из n фрагментов (без предварительной сборки)
+	bool try_push(uint8_t dest, const part *parts, size_t n)
+	{
+		size_t len = 0;
+		for(size_t i = 0; i < n; ++i) len += parts[i].len;
+		if(len > max_record()) return false;
+
+		const uint64_t k = cells_for(len);
+		uint64_t pos = enq_pos.load(std::memory_order_relaxed);
+
+		for(;;){
+			// Ячейки освобождаются потребителем по порядку: свободна последняя - свободны все
+			uint64_t last = pos + k - 1;
+			uint64_t seq = seqs[last & mask].load(std::memory_order_acquire);
+			int64_t diff = (int64_t)seq - (int64_t)last;
+
+			if(diff == 0){
+				if(enq_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) break;
+			}
+			else if(diff < 0) return false;
+			else pos = enq_pos.load(std::memory_order_relaxed);
+		}
+
+		header h{};
+		h.len = (uint32_t)len;
+		h.dest = dest;
+		write_at(pos, 0, reinterpret_cast<const char*>(&h), sizeof h);
+		size_t off = sizeof h;
+		for(size_t i = 0; i < n; ++i){
+			write_at(pos, off, parts[i].buf, parts[i].len);
+			off += parts[i].len;
+		}
+
+		// Публикация записи: потребитель проверяет только первую ячейку
+		seqs[pos & mask].store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Извлечение очередной записи (только поток-потребитель).
+	// Данные действительны до вызова release()
+	bool front(uint8_t &dest, const char *&buf, size_t &len)
+	{
+		uint64_t pos = deq_pos.load(std::memory_order_relaxed);
+		if(seqs[pos & mask].load(std::memory_order_acquire) != pos + 1) return false;
+
+		header h;
+		read_at(pos, 0, reinterpret_cast<char*>(&h), sizeof h);
+		dest = h.dest;
+		len = h.len;
+
+		size_t off = (size_t)((pos & mask) * cell_size) + sizeof h;
+		if(off + len <= cells_num * cell_size){
+			buf = &data[off];
+		}
+		else{
+			// Запись переходит через конец буфера - собираем во временный буфер
+			read_at(pos, sizeof h, scratch.get(), len);
+			buf = scratch.get();
+		}
+
+		cur_cells = cells_for(len);
+		return true;
+	}
+
+	// Освобождение ячеек записи, полученной через front()
+	void release()
+	{
+		uint64_t pos = deq_pos.load(std::memory_order_relaxed);
+		for(uint64_t i = 0; i < cur_cells; ++i){
+			seqs[(pos + i) & mask].store(pos + i + cells_num, std::memory_order_release);
+		}
+		deq_pos.store(pos + cur_cells, std::memory_order_release);
+		cur_cells = 0;
+	}
+
+	// Позиция, до которой очередь заполнена производителями
+	uint64_t head() const { return enq_pos.load(std::memory_order_acquire); }
+	// Позиция, до которой очередь обработана потребителем
+	uint64_t tail() const { return deq_pos.load(std::memory_order_acquire); }
+
+	bool empty() const { return tail() >= head(); }
+
+private:
+	size_t cells_num = 0;
+	uint64_t mask = 0;
+	std::unique_ptr<char[]> data;
+	std::unique_ptr<std::atomic<uint64_t>[]> seqs;
+
+	alignas(64) std::atomic<uint64_t> enq_pos{0};	// позиция записи (производители)
+	alignas(64) std::atomic<uint64_t> deq_pos{0};	// позиция чтения (потребитель)
+	uint64_t cur_cells = 0;							// число ячеек текущей записи потребителя
+	std::unique_ptr<char[]> scratch;				// буфер сборки записей, переходящих через конец кольца
+
+	static uint64_t cells_for(size_t len) { return (len + sizeof(header) + cell_size - 1) / cell_size; }
+
+	void write_at(uint64_t pos, size_t off, const char *src, size_t len)
+	{
+		const size_t total = cells_num * cell_size;
+		size_t start = (size_t)(((pos & mask) * cell_size + off) % total);
+		size_t first = std::min(len, total - start);
+		std::memcpy(&data[start], src, first);
+		if(first < len) std::memcpy(&data[0], src + first, len - first);
+	}
+
+	void read_at(uint64_t pos, size_t off, char *dst, size_t len) const
+	{
+		const size_t total = cells_num * cell_size;
+		size_t start = (size_t)(((pos & mask) * cell_size + off) % total);
+		size_t first = std::min(len, total - start);
+		std::memcpy(dst, &data[start], first);
+		if(first < len) std::memcpy(dst + first, &data[0], len - first);
+	}
+};
+
+// Буфер записей, отложенных при перегрузке (FIFO ограниченного объема). Не потокобезопасен.
+// При заполнении либо вытесняются самые старые записи (evict), либо отбрасывается новая.
+// Память выделяется по мере необходимости и сохраняется после опустошения
+class log_backlog
+{
+public:
+	// Установка предельного объема [Байт] и поведения при заполнении
+	void reset(size_t limit, bool evict)
+	{
+		max_size = limit;
+		evict_old = evict;
+	}
+
+	// Помещение записи. accepted - запись помещена; возвращается число отброшенных записей
+	// (вытесненных или самой новой)
+	size_t push(uint8_t dest, const char *buf, size_t len, bool &accepted)
+	{
+		const size_t need = sizeof(header) + len;
+		size_t dropped = 0;
+
+		accepted = false;
+		if(need > max_size) return 1;
+
+		if(evict_old){
+			while(tail - head + need > max_size){
+				pop();
+				++dropped;
+			}
+		}
+		else if(tail - head + need > max_size) return 1;
+
+		// Недостаточно места в конце: сдвиг данных в начало, при необходимости - увеличение буфера
+		if(tail + need > data.size()){
+			if(head){
+				std::memmove(data.data(), data.data() + head, tail - head);
+				tail -= head;
+				head = 0;
+			}
+			if(tail + need > data.size())
+				data.resize(std::min(max_size, std::max(tail + need, data.size() * 2)));
+		}
+
+		header h{};
+		h.len = (uint32_t)len;
+		h.dest = dest;
+		std::memcpy(&data[tail], &h, sizeof h);
+		std::memcpy(&data[tail + sizeof h], buf, len);
+		tail += need;
+		++count;
+
+		accepted = true;
+		return dropped;
+	}
+
+	// Получение самой старой записи. Данные действительны до pop()
+	bool front(uint8_t &dest, const char *&buf, size_t &len) const
+	{
+		if(!count) return false;
+
+		header h;
+		std::memcpy(&h, &data[head], sizeof h);
+		dest = h.dest;
+		len = h.len;
+		buf = &data[head + sizeof h];
+		return true;
+	}
+
+	void pop()
+	{
+		header h;
+		std::memcpy(&h, &data[head], sizeof h);
+		head += sizeof h + h.len;
+		if(!--count) head = tail = 0;
+	}
+
+	bool empty() const { return !count; }
+	size_t size() const { return count; }
+
+	// Обмен хранимыми записями (пределы объема не обмениваются)
+	void swap(log_backlog &other)
+	{
+		data.swap(other.data);
+		std::swap(head, other.head);
+		std::swap(tail, other.tail);
+		std::swap(count, other.count);
+	}
+
+private:
+	struct header{
+		uint32_t len;
+		uint8_t dest;
+	};
+
+	std::vector<char> data;
+	size_t head = 0, tail = 0;		// границы хранимых записей в data
+	size_t count = 0;				// число записей
+	size_t max_size = 0;
+	bool evict_old = false;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef _LOG_SINK_HPP
+#define _LOG_SINK_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <memory>
+
+// Уровень сообщения для вывода (совпадает с объявлением в logger.hpp)
+using log_lvl_t = uint8_t;
+
+// Приемник сформированных записей лога. Запись (штамп + текст) формируется логером один раз
+// и передается всем приемникам, уровень которых не ниже уровня сообщения.
+// write() вызывается из потока, сформировавшего запись, или из потока вывода асинхронного
+// режима - реализация должна быть потокобезопасной и не должна логировать через тот же логер
+class log_sink
+{
+public:
+	explicit log_sink(log_lvl_t lvl): lvl(lvl) {}
+	virtual ~log_sink() = default;
+
+	log_sink(const log_sink&) = delete;
+	log_sink& operator=(const log_sink&) = delete;
+
+	// Уровень приемника (MSG_SILENT - приемник выключен)
+	log_lvl_t get_lvl() const { return lvl.load(std::memory_order_relaxed); }
+	void set_lvl(log_lvl_t new_lvl) { lvl.store(new_lvl, std::memory_order_relaxed); changed(); }
+
+	// Счетчик изменений уровней и состава приемников: логер пересчитывает максимальный уровень
+	// своих приемников, только если счетчик изменился
+	static uint32_t epoch() { return epoch_num.load(std::memory_order_acquire); }
+	static void changed() { epoch_num.fetch_add(1, std::memory_order_acq_rel); }
+
+	// Приемник принимает сообщения уровня msg_lvl
+	bool accepts(log_lvl_t msg_lvl) const { return msg_lvl && msg_lvl <= get_lvl(); }
+
+	// Вывод записи уровня msg_lvl
+	virtual void write(log_lvl_t msg_lvl, const char *rec, size_t len) = 0;
+
+	// Завершение вывода накопленных данных
+	virtual void flush() {}
+
+private:
+	std::atomic<log_lvl_t> lvl;
+	static inline std::atomic<uint32_t> epoch_num{0};
+};
+
+// Вывод в открытый дескриптор (например, STDERR_FILENO). Дескриптор не закрывается
+class log_fd_sink : public log_sink
+{
+public:
+	log_fd_sink(int fd, log_lvl_t lvl): log_sink(lvl), fd(fd) {}
+
+	void write(log_lvl_t msg_lvl, const char *rec, size_t len) override;
+
+private:
+	int fd;
+};
+
+// Запись в отдельный файл без ротации (например, журнал только ошибок).
+// Файл открывается с O_APPEND: записи разных потоков не перемешиваются
+class log_file_sink : public log_sink
+{
+public:
+	log_file_sink(const std::string &fname, log_lvl_t lvl);
+	~log_file_sink() override;
+
+	bool is_open() const { return fd >= 0; }
+	void write(log_lvl_t msg_lvl, const char *rec, size_t len) override;
+	void flush() override;
+
+private:
+	int fd = -1;
+};
+
+// Кольцевой буфер последних записей в памяти (объем size Байт). При заполнении
+// вытесняются самые старые записи целиком
+class log_ring_sink : public log_sink
+{
+public:
+	log_ring_sink(size_t size, log_lvl_t lvl);
+
+	void write(log_lvl_t msg_lvl, const char *rec, size_t len) override;
+
+	// Содержимое буфера: записи от старых к новым
+	std::string contents() const;
+
+	// Очистка буфера
+	void clear();
+
+private:
+	mutable std::mutex mutex;
+	std::unique_ptr<char[]> data;
+	size_t size;
+	size_t head = 0;		// позиция самой старой записи
+	size_t used = 0;		// объем хранимых записей [Байт]
+
+	void write_at(size_t pos, const char *src, size_t n);
+	void read_at(size_t pos, char *dst, size_t n) const;
+};
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef _LOG_SITE_HPP
+#define _LOG_SITE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <string>
+#include <functional>
+#include <type_traits>
+
+// Уровень сообщения для вывода (совпадает с объявлением в logger.hpp)
+using log_lvl_t = uint8_t;
+
+class log_limit;
+
+// Описатель места вызова макроса логирования. Формируется при компиляции один раз для каждого
+// раскрытия макроса (см. LOG_SITE) и хранится в статической памяти: имя файла без пути и имя функции
+// (указатели на __FILE__ и __func__, строки не копируются), строка, уровень и префикс записи.
+// Строка формата записи (префикс с местом вызова и строка формата сообщения) не содержит
+// escape-последовательностей подсветки: для вывода в терминал префикс записи (plain_len Байт
+// после штампа) заменяется подготовленным префиксом с подсветкой color
+struct log_site
+{
+	const char *file;		// имя файла без пути
+	const char *func;		// имя функции (__func__)
+	uint32_t line;
+	log_lvl_t flags;		// флаги макроса (0 - задаются при вызове)
+	const char *color;		// префикс записи с подсветкой (пустой - без подсветки)
+	uint16_t color_len;
+	uint16_t plain_len;		// длина префикса записи без подсветки
+	const log_limit *limit;	// охватывающее ограничение частоты вывода (см. LOG_LIMITED)
+
+	// Размещение места вызова в префиксе записи
+	enum loc_t : uint8_t {
+		loc_none = 0,		// без места вызова
+		loc_full,			// "file func():line "
+		loc_func,			// "(in func) "
+	};
+};
+
+// Управление выводом мест вызова во время выполнения (аналог dynamic debug ядра Linux).
+// Состояние размещается макросом рядом с описателем места вызова (инициализируется при компиляции),
+// проверка режима - одна атомарная загрузка. Место вызова регистрируется в общем для процесса
+// реестре при первом выполнении и получает режим по заданным ранее правилам.
+// Шаблон правила (glob, см. fnmatch(3)) сравнивается с именем файла или функции места вызова:
+//	"net_*.cpp", "on_*", "parse_header", "conn.cpp:120" (файл и строка)
+class log_site_ctl
+{
+public:
+	enum mode_t : uint8_t {
+		mode_unknown = 0,	// место вызова еще не выполнялось
+		mode_default,		// вывод по уровню логера (модуля)
+		mode_on,			// вывод независимо от уровня логера
+		mode_off,			// вывод отключен
+	};
+
+	constexpr log_site_ctl() = default;
+	log_site_ctl(const log_site_ctl&) = delete;
+	log_site_ctl& operator=(const log_site_ctl&) = delete;
+
+	// Режим места вызова site (регистрация при первом обращении)
+	mode_t mode(const log_site &site){
+		uint8_t m = state.load(std::memory_order_relaxed);
+		return (m != mode_unknown) ? (mode_t)m : attach(site);
+	}
+
+	// Установка режима местам вызова, подходящим под шаблон. Правило сохраняется и применяется
+	// к местам вызова, выполненным позже. Возвращает число измененных зарегистрированных мест вызова
+	static size_t set(const std::string &pattern, mode_t mode);
+
+	// Выполнение команды "+шаблон" (включение), "-шаблон" (отключение) или "=шаблон" (режим по уровню).
+	// Пустые строки и строки, начинающиеся с '#', пропускаются. Возвращает false при ошибке в команде
+	static bool apply(const std::string &cmd);
+
+	// Выполнение команд из файла (по одной в строке), например по сигналу SIGHUP
+	static bool load(const std::string &fname);
+
+	// Удаление всех правил: все места вызова выводятся по уровню
+	static void reset();
+
+	// Обход всех зарегистрированных мест вызова
+	static void for_each(const std::function<void(const log_site&, mode_t)> &fn);
+
+private:
+	mode_t attach(const log_site &site);
+
+	std::atomic<uint8_t> state{mode_unknown};
+};
+
+// Строка формата места вызова, заданная во время выполнения (не строковым литералом, см. LOG_SITE_ARG):
+// разбирается при каждом вызове, строка без аргументов выводится как есть
+struct log_site_rt
+{
+	const char *fmt;
+	size_t len;
+	const char *prefix;			// префикс записи без подсветки (site.plain_len Байт)
+	const char *suffix;			// формат, дописываемый после сообщения (nullptr - нет)
+	uint8_t suffix_args;		// число последних аргументов, выводимых по suffix
+	const log_site &site;
+	log_site_ctl &ctl;
+};
+
+namespace log_site_text {
+
+// Построение строки при компиляции: O - строка (text) или счетчик длины (counter)
+template<typename O>
+struct builder{
+	constexpr void add(const char *p, size_t n) { for(size_t i = 0; i < n; ++i) out().add(p[i]); }
+	// Текст, подставляемый в строку формата ('%' удваивается)
+	constexpr void add_text(const char *p, size_t n) { for(size_t i = 0; i < n; ++i){ if(p[i] == '%') out().add('%'); out().add(p[i]); } }
+	constexpr void add_uint(uint32_t v){
+		char d[10] = {};
+		size_t n = 0;
+		do{ d[n++] = (char)('0' + v % 10); v /= 10; }while(v);
+		while(n) out().add(d[--n]);
+	}
+	// Текст без escape-последовательностей подсветки ("\x1b[...m")
+	constexpr void add_plain(const char *p, size_t n){
+		for(size_t i = 0; i < n; ++i){
+			if(p[i] != '\x1b'){ out().add(p[i]); continue; }
+			while(i < n && p[i] != 'm') ++i;
+		}
+	}
+
+private:
+	constexpr O& out() { return static_cast<O&>(*this); }
+};
+
+// Строка фиксированной емкости (N - длина строки с завершающим нулем)
+template<size_t N>
+struct text: builder<text<N>>{
+	using builder<text<N>>::add;
+
+	char s[N] = {};
+	size_t len = 0;
+
+	constexpr void add(char c) { if(len + 1 < N) s[len++] = c; }
+};
+
+// Подсчет длины строки (без завершающего нуля)
+struct counter: builder<counter>{
+	using builder<counter>::add;
+
+	size_t len = 0;
+
+	constexpr void add(char) { ++len; }
+};
+
+// Начало имени файла без пути
+constexpr size_t basename_pos(const char *path, size_t n)
+{
+	size_t pos = 0;
+	for(size_t i = 0; i < n; ++i) if(path[i] == '/' || path[i] == '\\') pos = i + 1;
+	return pos;
+}
+
+// Границы имени функции в __PRETTY_FUNCTION__ ("int ns::Class::method(int) const [with T = int]"
+// -> "ns::Class::method"): от последнего пробела перед списком параметров до '(' вне угловых скобок
+constexpr void func_range(const char *p, size_t n, size_t &beg, size_t &end)
+{
+	int depth = 0;
+	end = n;
+	for(size_t i = 0; i < n; ++i){
+		if(p[i] == '<') ++depth;
+		else if(p[i] == '>') --depth;
+		else if(p[i] == '(' && depth == 0 && i > 0){ end = i; break; }
+	}
+
+	beg = 0;
+	depth = 0;
+	for(size_t i = end; i > 0; --i){
+		char c = p[i - 1];
+		if(c == '>') ++depth;
+		else if(c == '<') --depth;
+		else if(c == ' ' && depth == 0){ beg = i; break; }
+	}
+}
+
+// Вид строки места вызова
+enum part_t : uint8_t {
+	part_plain,				// префикс записи без подсветки
+	part_color,				// префикс записи с подсветкой
+	part_fmt,				// строка формата записи: префикс без подсветки ('%' удваивается) и формат сообщения
+};
+
+// Строка места вызова: head + место вызова (loc) + tail [+ msg + suffix]. Имя файла берется без пути
+template<typename O, size_t H, size_t F, size_t G, size_t T, size_t S>
+constexpr void render(O &o, part_t part, const char (&head)[H], const char (&file)[F], const char (&func)[G],
+	uint32_t line, const char (&tail)[T], log_site::loc_t loc, const char (&msg)[S], const char *suffix = "")
+{
+	auto put = [&o, part](const char *p, size_t n){ (part == part_fmt) ? o.add_text(p, n) : o.add(p, n); };
+	auto deco = [&o, part](const char *p, size_t n){ (part == part_color) ? o.add(p, n) : o.add_plain(p, n); };
+
+	deco(head, H - 1);
+
+	size_t base = basename_pos(file, F - 1);
+	if(loc == log_site::loc_full){
+		put(file + base, F - 1 - base);
+		o.add(' ');
+		put(func, G - 1);
+		o.add("():", 3);
+		o.add_uint(line);
+		o.add(' ');
+	}
+	else if(loc == log_site::loc_func){
+		o.add("(in ", 4);
+		put(func, G - 1);
+		o.add(") ", 2);
+	}
+
+	deco(tail, T - 1);
+
+	if(part != part_fmt) return;
+	o.add(msg, S - 1);
+	while(*suffix) o.add(*suffix++);
+}
+
+// Размер строки места вызова (с завершающим нулем)
+template<size_t H, size_t F, size_t G, size_t T, size_t S>
+constexpr size_t measure(part_t part, const char (&head)[H], const char (&file)[F], const char (&func)[G],
+	uint32_t line, const char (&tail)[T], log_site::loc_t loc, const char (&msg)[S], const char *suffix = "")
+{
+	counter c{};
+	render(c, part, head, file, func, line, tail, loc, msg, suffix);
+	return c.len + 1;
+}
+
+// Размер префикса с подсветкой (1 - префикс без подсветки, подставлять нечего)
+template<size_t H, size_t F, size_t G, size_t T>
+constexpr size_t color_size(const char (&head)[H], const char (&file)[F], const char (&func)[G],
+	uint32_t line, const char (&tail)[T], log_site::loc_t loc)
+{
+	size_t n = measure(part_color, head, file, func, line, tail, loc, "");
+	return (n == measure(part_plain, head, file, func, line, tail, loc, "")) ? 1 : n;
+}
+
+// Формирование строки места вызова размером N (см. measure)
+template<size_t N, size_t H, size_t F, size_t G, size_t T, size_t S>
+constexpr text<N> make(part_t part, const char (&head)[H], const char (&file)[F], const char (&func)[G],
+	uint32_t line, const char (&tail)[T], log_site::loc_t loc, const char (&msg)[S], const char *suffix = "")
+{
+	text<N> t{};
+	if(N > 1) render(t, part, head, file, func, line, tail, loc, msg, suffix);
+	return t;
+}
+
+// Число аргументов строки формата (спецификаторы, кроме "%%")
+constexpr uint8_t arg_count(const char *fmt)
+{
+	uint8_t n = 0;
+	for(; *fmt; ++fmt){
+		if(*fmt != '%') continue;
+		if(fmt[1] == '%') ++fmt;
+		else ++n;
+	}
+	return n;
+}
+
+// Признак строкового литерала (выражение типа const char(&)[N])
+template<typename T>
+struct literal_tag: std::false_type {};
+template<size_t N>
+struct literal_tag<const char (&)[N]>: std::true_type {};
+
+// Строка формата, заданная во время выполнения
+inline log_site_rt runtime(const char *fmt, const char *prefix, const char *suffix, const log_site &site, log_site_ctl &ctl)
+{
+	if(!fmt) fmt = "(null)";
+	return log_site_rt{fmt, std::strlen(fmt), prefix, *suffix ? suffix : nullptr, arg_count(suffix), site, ctl};
+}
+
+inline log_site_rt runtime(const std::string &fmt, const char *prefix, const char *suffix, const log_site &site, log_site_ctl &ctl)
+{
+	return log_site_rt{fmt.c_str(), fmt.size(), prefix, *suffix ? suffix : nullptr, arg_count(suffix), site, ctl};
+}
+
+// Имя метода с круглыми скобками ("Class::method()") для сообщений исключений
+template<typename O, size_t G>
+constexpr void render_method(O &o, const char (&pretty)[G])
+{
+	size_t beg = 0, end = 0;
+	func_range(pretty, G - 1, beg, end);
+	o.add(pretty + beg, end - beg);
+	o.add("()", 2);
+}
+
+template<size_t G>
+constexpr size_t method_size(const char (&pretty)[G])
+{
+	counter c{};
+	render_method(c, pretty);
+	return c.len + 1;
+}
+
+template<size_t N, size_t G>
+constexpr text<N> method(const char (&pretty)[G])
+{
+	text<N> t{};
+	render_method(t, pretty);
+	return t;
+}
+
+// Префикс "func():line " для сообщений исключений
+template<size_t G>
+constexpr text<G + 16> func_line(const char (&func)[G], uint32_t line)
+{
+	text<G + 16> t{};
+	t.add(func, G - 1);
+	t.add("():", 3);
+	t.add_uint(line);
+	t.add(' ');
+	return t;
+}
+
+// Строка формата с управляемым местом вызова (объявлена макросом LOG_SITE)
+template<typename F, typename = void>
+struct has_ctl: std::false_type {};
+template<typename F>
+struct has_ctl<F, std::void_t<decltype(F::ctl())>>: std::true_type {};
+
+// Описатель места вызова строки формата (nullptr - строка формата без места вызова)
+template<typename F>
+constexpr const log_site* site_of()
+{
+	if constexpr (has_ctl<F>::value) return &F::site();
+	else return nullptr;
+}
+
+}
+
+// Флаги макроса для описателя: известные при компиляции или 0
+#define LOG_SITE_FLAGS(flags)	(__builtin_constant_p(flags) ? (log_lvl_t)(flags) : (log_lvl_t)0)
+
+// Аргументы построения строк места вызова
+#define LOG_SITE_PARTS(site_head, site_loc, site_tail) \
+	site_head, __FILE__, log_site_func, __LINE__, site_tail, site_loc
+
+// Объявление описателя места вызова log_site_desc, его состояния log_site_state и функции log_site_format,
+// возвращающей строку формата записи (см. LOG_SITE_ARG). Используется внутри функции.
+// Строка формата site_fmt в ветви для литерала используется только в шаблоне (generic-лямбда),
+// поэтому для строки, заданной во время выполнения, эта ветвь не формируется
+// suffix - формат, дописываемый после сообщения (строковый литерал).
+// Строки формируются точно по размеру: префикс записи (с подсветкой - только при ее наличии)
+// и строка формата записи, имена файла и функции не копируются
+#define LOG_SITE(site_flags, site_head, site_loc, site_tail, site_fmt, site_suffix) \
+	static constexpr const auto &log_site_func = __func__; 				\
+	static constexpr auto log_site_color = log_site_text::make<log_site_text::color_size( \
+		LOG_SITE_PARTS(site_head, site_loc, site_tail))>(log_site_text::part_color, \
+		LOG_SITE_PARTS(site_head, site_loc, site_tail), ""); 			\
+	[[maybe_unused]] static constexpr log_site log_site_desc{ 			\
+		__FILE__ + log_site_text::basename_pos(__FILE__, sizeof(__FILE__) - 1), __func__, \
+		__LINE__, LOG_SITE_FLAGS(site_flags), log_site_color.s, (uint16_t)log_site_color.len, \
+		(uint16_t)(log_site_text::measure(log_site_text::part_plain, 	\
+			LOG_SITE_PARTS(site_head, site_loc, site_tail), "") - 1), &log_site_limit}; \
+	static log_site_ctl log_site_state; 								\
+	auto log_site_format = [&](auto log_site_tag, const auto &log_site_arg){ \
+		using log_site_tag_t = decltype(log_site_tag); 					\
+		if constexpr (log_site_tag_t::value){ 							\
+			constexpr auto log_site_msg = [&](auto) -> decltype(auto) { return (site_fmt); }; \
+			static constexpr auto log_site_strs = log_site_text::make<log_site_text::measure( \
+				log_site_text::part_fmt, LOG_SITE_PARTS(site_head, site_loc, site_tail), \
+				log_site_msg(0), site_suffix)>(log_site_text::part_fmt, \
+				LOG_SITE_PARTS(site_head, site_loc, site_tail), log_site_msg(0), site_suffix); \
+			struct log_site_fmt: log_fmt::fmt_string { 					\
+				static constexpr const char* str() { return log_site_strs.s; } \
+				static constexpr const log_site& site() { return log_site_desc; } \
+				static log_site_ctl& ctl() { return log_site_state; } 	\
+			}; 															\
+			return log_site_fmt{}; 										\
+		} 																\
+		else{ 															\
+			static constexpr auto log_site_plain = log_site_text::make<log_site_text::measure( \
+				log_site_text::part_plain, LOG_SITE_PARTS(site_head, site_loc, site_tail), "")>( \
+				log_site_text::part_plain, LOG_SITE_PARTS(site_head, site_loc, site_tail), ""); \
+			return log_site_text::runtime(log_site_arg, log_site_plain.s, site_suffix, log_site_desc, log_site_state); \
+		} 																\
+	}
+
+// Строка формата записи места вызова (объявленного LOG_SITE): для строкового литерала - тип строки
+// формата, разбираемой и проверяемой при компиляции (как LOG_FMT), для строки, заданной во время
+// выполнения (const char*, std::string), - log_site_rt (формат разбирается при каждом вызове)
+#define LOG_SITE_ARG(site_fmt) 	log_site_format(log_site_text::literal_tag<decltype(site_fmt)>{}, site_fmt)
+
+#endif
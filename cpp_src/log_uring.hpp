@@ -0,0 +1,100 @@
+#ifndef _LOG_URING_HPP
+#define _LOG_URING_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// Запись лог-файла через io_uring. Данные накапливаются в блоках фиксированного размера,
+// блок отправляется ядру операцией записи по явному смещению (при необходимости связанной
+// с fdatasync) и освобождается после получения результата. Пишущий поток не ожидает
+// завершения записи: результаты собираются пакетами без системных вызовов, ожидание
+// возможно только при занятости всех блоков.
+//
+// Очередной блок отправляется, как только он заполнен или когда у ядра нет незавершенных
+// операций: при малом потоке сообщений запись не задерживается, при большом - объединяется.
+//
+// Если io_uring недоступен (старое ядро, запрет seccomp), блоки записываются pwrite().
+// Класс не потокобезопасен: вызовы выполняются под блокировкой лог-файла
+class log_uring
+{
+public:
+	// Размер блока [Байт] и число блоков (глубина очереди)
+	static constexpr size_t block_size = 65536;
+	static constexpr unsigned blocks_num = 8;
+
+	// sync - каждая запись блока сопровождается fdatasync
+	explicit log_uring(bool sync = false);
+	~log_uring();
+
+	log_uring(const log_uring&) = delete;
+	log_uring& operator=(const log_uring&) = delete;
+
+	// Используется io_uring (false - запись через pwrite)
+	bool is_native() const { return ring_fd >= 0 && !broken; }
+
+	// Число выполненных системных вызовов
+	uint64_t syscalls() const { return calls; }
+
+	// Смена файла: накопленные данные отправляются в прежний файл,
+	// далее запись выполняется в fd начиная со смещения offset
+	void attach(int fd, uint64_t offset);
+
+	// Добавление данных в конец файла. Возвращает число принятых Байт
+	size_t write(const char *buf, size_t len);
+
+	// Отправка накопленных данных без ожидания записи
+	void submit();
+
+	// Отправка накопленных данных и ожидание завершения всех операций
+	void drain();
+
+private:
+	struct block_t{
+		std::unique_ptr<char[]> data;
+		size_t len = 0;
+		uint64_t off = 0;
+		int fd = -1;
+		bool busy = false;			// блок отправлен, результат не получен
+	};
+
+	// Кольца очереди отправки (SQ) и завершения (CQ), отображенные из ядра
+	struct ring_t{
+		void *sq_ptr = nullptr;
+		void *cq_ptr = nullptr;
+		void *sqes = nullptr;
+		size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+		unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+		unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+		void *cqes = nullptr;
+	};
+
+	int ring_fd = -1;
+	ring_t ring;
+	bool sync;
+	bool broken = false;			// ядро не поддерживает запись через io_uring
+
+	block_t blocks[blocks_num];
+	block_t *cur = nullptr;			// заполняемый блок
+	unsigned inflight = 0;			// число отправленных блоков
+	unsigned queued = 0;			// число подготовленных, но не отправленных SQE
+	int fd = -1;
+	uint64_t off = 0;				// смещение следующих данных в файле
+	uint64_t calls = 0;
+
+	bool setup();
+	void teardown();
+
+	// Получение свободного блока (при необходимости - ожидание завершения записи)
+	block_t* take_block();
+	// Отправка заполняемого блока
+	void submit_block();
+	// Запись блока синхронно (резервный режим и дозапись после неполной записи)
+	void write_sync(block_t &b, size_t done);
+	// Сбор результатов завершенных операций. wait - ожидать хотя бы одну
+	void reap(bool wait);
+	// Передача подготовленных SQE ядру
+	void enter(unsigned min_complete);
+};
+
+#endif
@@ -1,111 +1,2395 @@
 #include <ctime>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fnmatch.h>
 #include <sstream>
+#include <fstream>
 #include <iterator>
 
 #include "logger.hpp"
 
+// io_uring используется при наличии заголовков ядра, иначе запись выполняется pwrite()
+#if __has_include(<linux/io_uring.h>)
+	#include <linux/io_uring.h>
+	#define LOG_HAVE_URING
+#endif
+
 // Инициализация статических членов класса
 std::recursive_mutex Logging::log_print_mutex;
+std::atomic<const Logging*> Logging::recorders[LOG_RECORDERS_MAX];
 // std::recursive_timed_mutex Logging::log_file_mutex;
 
 
-// Формирование штампа сообщения
-std::string Logging::make_msg_stamp(stamp_t type, const std::string &module_name, const char *fmt)
+// Запись буфера в файловый дескриптор целиком (с повтором при прерывании сигналом)
+static size_t write_all(int fd, const char *buf, size_t len)
+{
+	size_t done = 0;
+	while(done < len){
+		ssize_t n = ::write(fd, buf + done, len - done);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			break;
+		}
+		done += n;
+	}
+
+	return done;
+}
+
+// Запись нескольких буферов в файловый дескриптор целиком одним writev()
+// (с продолжением после неполной записи или прерывания сигналом)
+static size_t writev_all(int fd, struct iovec *iov, int cnt)
+{
+	size_t done = 0;
+	while(cnt){
+		ssize_t n = ::writev(fd, iov, cnt);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			break;
+		}
+		if(n == 0) break;
+		done += n;
+
+		// Пропуск записанных буферов
+		while(cnt && (size_t)n >= iov->iov_len){
+			n -= iov->iov_len;
+			++iov;
+			--cnt;
+		}
+		if(cnt){
+			iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	return done;
+}
+
+namespace {
+
+// Таблица 16-ричного представления байт: "00 " ... "FF " (4-й байт позволяет копировать запись целиком)
+struct hex_table_t{
+	char text[256][4];
+
+	constexpr hex_table_t(): text(){
+		const char digits[] = "0123456789ABCDEF";
+		for(int b = 0; b < 256; ++b){
+			text[b][0] = digits[b >> 4];
+			text[b][1] = digits[b & 0xF];
+			text[b][2] = ' ';
+			text[b][3] = ' ';
+		}
+	}
+};
+
+constexpr hex_table_t hex_table;
+
+// Таблица отображения байт в колонке символов: печатные ASCII символы, остальные - '.'
+struct print_table_t{
+	char chr[256];
+
+	constexpr print_table_t(): chr(){
+		for(int b = 0; b < 256; ++b) chr[b] = (b >= 0x20 && b < 0x7F) ? (char)b : '.';
+	}
+};
+
+constexpr print_table_t print_table;
+
+// Формирование дампа: строки вида
+//	<TAB>смещение  XX XX XX XX XX XX XX XX  XX ... XX  |символы|
+// по per_line байт с дополнительным пробелом после каждых 8 байт
+void render_hexdump(log_buf &out, const uint8_t *buf, size_t len, size_t per_line)
+{
+	const size_t hex_len = per_line * 3 + (per_line - 1) / 8;
+	const size_t line_max = 1 + 16 + 2 + hex_len + 3 + per_line + 2;
+	const size_t lines = (len + per_line - 1) / per_line;
+
+	// Место под весь дамп выделяется сразу (+1 Байт для копирования записей таблицы по 4 Байта)
+	char *start = out.tail(lines * line_max + 1);
+	char *p = start;
+
+	for(size_t off = 0; off < len; off += per_line){
+		size_t n = std::min(per_line, len - off);
+		*p++ = '\t';
+
+		// Смещение: не менее 8 16-ричных разрядов
+		int digits = 8;
+		while(digits < 16 && (off >> (4 * digits))) ++digits;
+		for(int d = digits - 1, v = 0; d >= 0; --d, ++v) p[d] = "0123456789abcdef"[(off >> (4 * v)) & 0xF];
+		p += digits;
+		*p++ = ' ';
+		*p++ = ' ';
+
+		char *hex = p;
+		for(size_t i = 0; i < n; ++i){
+			std::memcpy(p, hex_table.text[buf[off + i]], 4);
+			p += 3;
+			if((i + 1) % 8 == 0 && i + 1 < per_line) *p++ = ' ';
+		}
+		// Выравнивание колонки символов для неполной строки
+		size_t used = p - hex;
+		std::memset(p, ' ', hex_len - used);
+		p += hex_len - used;
+
+		*p++ = ' ';
+		*p++ = '|';
+		for(size_t i = 0; i < n; ++i) *p++ = print_table.chr[buf[off + i]];
+		*p++ = '|';
+		*p++ = '\n';
+	}
+
+	out.commit(p - start);
+}
+
+// Кэш отображения времени штампа. Дата и время перерисовываются только при смене секунды
+// (или формата), доли секунды дописываются в подготовленную позицию.
+// Кэш свой у каждого потока - синхронизация не требуется
+struct stamp_cache_t{
+	time_t sec = -1;
+	Logging::stamp_t type = Logging::no_stamp;
+	const char *fmt = nullptr;
+	char text[LOG_STAMP_MAX_LEN];	// отображение времени
+	size_t len = 0;					// длина отображения времени
+	size_t frac_pos = 0;			// позиция долей секунды в text
+	size_t frac_digits = 0;			// число разрядов долей секунды
+};
+
+thread_local stamp_cache_t stamp_cache;
+
+// Перерисовка отображения времени в кэше
+void render_stamp_cache(stamp_cache_t &c, const struct tm &timeinfo, Logging::stamp_t type, const char *fmt)
+{
+	c.frac_digits = 0;
+
+	switch(type){
+		case Logging::only_time: c.len = strftime(c.text, sizeof c.text, "[ %T ]", &timeinfo); break;
+		case Logging::ms_time: c.frac_digits = 3; break;
+		case Logging::us_time: c.frac_digits = 6; break;
+		case Logging::ns_time: c.frac_digits = 9; break;
+		case Logging::custom: c.len = strftime(c.text, sizeof c.text, fmt ? fmt : "", &timeinfo); break;
+		case Logging::date_time:
+		default:
+			c.len = strftime(c.text, sizeof c.text, "[ %d.%m.%y %T ]", &timeinfo); break;
+	}
+
+	if(c.frac_digits){
+		c.frac_pos = strftime(c.text, sizeof c.text, "[ %d.%m.%y %T.", &timeinfo);
+		std::memcpy(&c.text[c.frac_pos + c.frac_digits], " ]", 2);
+		c.len = c.frac_pos + c.frac_digits + 2;
+	}
+}
+}
+
+// Формирование штампа сообщения
+size_t Logging::make_msg_stamp(char *buf, size_t size, const struct timespec &spec, stamp_t type, const std::string &module_name, const char *fmt)
+{
+	if(!size) return 0;
+	buf[0] = '\0';
+	if(type == no_stamp) return 0;
+
+	stamp_cache_t &c = stamp_cache;
+
+	if(c.sec != spec.tv_sec || c.type != type || c.fmt != fmt){
+		struct tm timeinfo;
+		if(!localtime_r(&spec.tv_sec, &timeinfo)){
+			return (size_t)snprintf(buf, size, "localtime_r failed");
+		}
+
+		render_stamp_cache(c, timeinfo, type, fmt);
+		c.sec = spec.tv_sec;
+		c.type = type;
+		c.fmt = fmt;
+	}
+
+	// Доли секунды: 10^9 нс обрезаются до нужного числа разрядов
+	if(c.frac_digits){
+		unsigned long frac = spec.tv_nsec;
+		for(size_t i = c.frac_digits; i < 9; ++i) frac /= 10;
+		for(size_t i = c.frac_digits; i > 0; --i){
+			c.text[c.frac_pos + i - 1] = '0' + frac % 10;
+			frac /= 10;
+		}
+	}
+
+	// Отображение времени + имя модуля
+	size_t len = std::min(c.len, size - 1);
+	std::memcpy(buf, c.text, len);
+
+	size_t mod_len = std::min(module_name.size(), size - 1 - len);
+	std::memcpy(buf + len, module_name.data(), mod_len);
+	len += mod_len;
+	if(len < size - 1) buf[len++] = ' ';
+
+	buf[len] = '\0';
+	return len;
+}
+
+size_t Logging::make_msg_stamp(char *buf, size_t size, stamp_t type, const std::string &module_name, const char *fmt)
+{
+	struct timespec spec;
+	clock_gettime(CLOCK_REALTIME, &spec);
+
+	return make_msg_stamp(buf, size, spec, type, module_name, fmt);
+}
+
+std::string Logging::make_msg_stamp(stamp_t type, const std::string &module_name, const char *fmt)
+{
+	char buf[LOG_STAMP_MAX_LEN];
+	size_t len = make_msg_stamp(buf, sizeof buf, type, module_name, fmt);
+
+	return std::string(buf, len);
+}
+
+// Получение текущего размера открытого лог-файла
+uint64_t Logging::get_file_size(int fd)
+{
+    struct stat st;
+    if (0 != fstat(fd, &st)) return 0;
+
+    return (uint64_t)st.st_size;
+}
+
+// Открытие лог-файла. Обычно файл открывается в режиме O_APPEND: каждая запись добавляется
+// в конец файла одним write(). В режиме mapped место под весь файл выделяется сразу
+// и файл отображается в память. used - текущая длина данных файла
+int Logging::open_log(const char *name, bool trunc, char *&map, uint64_t &used) const
+{
+	// Отображение требует доступа на чтение, io_uring пишет по явным смещениям
+	int flags = O_CREAT | O_CLOEXEC | (trunc ? O_TRUNC : 0) | 
+		(mapped ? O_RDWR : (uring_mode ? O_WRONLY : (O_WRONLY | O_APPEND)));
+	int fd = ::open(name, flags, 0644);
+
+	map = nullptr;
+	used = 0;
+	if(fd < 0) return -1;
+
+	used = Logging::get_file_size(fd);
+	if(!mapped) return fd;
+
+	const uint64_t size = sets.log_max_fsize;
+	int ret = ::fallocate(fd, 0, 0, (off_t)size);
+	// Файловая система не поддерживает fallocate - файл расширяется без выделения блоков
+	if(ret && errno == EOPNOTSUPP) ret = (used < size) ? ::ftruncate(fd, (off_t)size) : 0;
+
+	void *p = ret ? MAP_FAILED : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED){
+		// Восстановление длины файла, расширенного fallocate
+		if(!ret) (void)::ftruncate(fd, (off_t)used);
+		::close(fd);
+		return -1;
+	}
+
+	map = static_cast<char*>(p);
+	return fd;
+}
+
+// Закрытие лог-файла. Отображенный файл обрезается до фактической длины данных used
+void Logging::close_log(int fd, char *map, uint64_t used) const
+{
+	if(map){
+		::munmap(map, sets.log_max_fsize);
+		(void)::ftruncate(fd, (off_t)used);
+	}
+	::close(fd);
+}
+
+// Добавление данных в конец открытого лог-файла (в режиме mapped - копирование в отображение,
+// при пакетной записи - в буфер; urgent - буфер выводится вместе с данными сразу).
+// Возвращает число записанных Байт
+size_t Logging::append(const char *buf, size_t len, bool urgent) const
+{
+	sync_dirty = true;
+
+	if(log_map){
+		if(log_fsize + len > sets.log_max_fsize) return 0;
+		std::memcpy(log_map + log_fsize, buf, len);
+		log_fsize += len;
+		stats_block::add(local_stats().bytes_file, len);
+		return len;
+	}
+
+	if(uring){
+		size_t ret = uring->write(buf, len);
+		log_fsize += ret;
+		stats_block::add(local_stats().bytes_file, ret);
+		return ret;
+	}
+
+	if(batch_buf){
+		if(!urgent && batch_used + len < batch_size){
+			std::memcpy(batch_buf.get() + batch_used, buf, len);
+			batch_used += len;
+			log_fsize += len;
+			return len;
+		}
+		return flush_batch(buf, len);
+	}
+
+	size_t ret = write_all(log_fd, buf, len);
+	log_fsize += ret;
+	stats_block &st = local_stats();
+	stats_block::add(st.bytes_file, ret);
+	stats_block::add(st.writes_file);
+	return ret;
+}
+
+// Вывод буфера пакетной записи и записи rec (не поместившейся в буфер или срочной) одним writev().
+// Возвращает число записанных Байт записи rec
+size_t Logging::flush_batch(const char *rec, size_t len) const
+{
+	size_t used = batch_used;
+	if(!used && !len) return 0;
+	batch_used = 0;
+
+	struct iovec iov[2] = {{batch_buf.get(), used}, {const_cast<char*>(rec), len}};
+	size_t ret = writev_all(log_fd, iov, len ? 2 : 1);
+
+	stats_block &st = local_stats();
+	stats_block::add(st.bytes_file, ret);
+	stats_block::add(st.writes_file);
+	// Число записей в буфере не хранится - потеря буфера учитывается одной записью
+	if(ret < used) count_dropped(stats_t::drop_write_failed);
+
+	size_t done = (ret > used) ? ret - used : 0;
+	log_fsize += done;
+	return done;
+}
+
+// Сброс данных лог-файла на диск (очередь io_uring сбрасывает данные сама при set_uring(true, true))
+void Logging::sync_file() const
+{
+	if(log_fd < 0 || uring) return;
+
+	if(batch_used) flush_batch();
+	::fdatasync(log_fd);
+	sync_dirty = false;
+	synced_at = std::chrono::steady_clock::now();
+	stats_block::add(local_stats().syncs_file);
+}
+
+// Обслуживание лог-файла потоком ротации: вывод записей, накопленных в буфере дольше batch_ms,
+// и сброс данных на диск по политике sync_interval
+void Logging::service_file() const
+{
+	std::lock_guard<std::recursive_timed_mutex> lock(log_file_mutex);
+	if(log_fd < 0) return;
+
+	if(batch_used) flush_batch();
+	if((sync_policy & sync_interval) && sync_dirty &&
+	   std::chrono::steady_clock::now() - synced_at >= std::chrono::milliseconds(sync_ms)) sync_file();
+}
+
+// Период обслуживания лог-файла потоком ротации [мс] (0 - не требуется)
+uint32_t Logging::service_period() const
+{
+	uint32_t period = batch_size ? batch_ms : 0;
+	if(sync_policy & sync_interval) period = period ? std::min(period, sync_ms) : sync_ms;
+	return period;
+}
+
+// Включение (выключение) пакетной записи
+void Logging::set_batch(size_t size, uint32_t interval_ms)
+{
+	close_file();
+
+	std::lock_guard<std::recursive_timed_mutex> lock(log_file_mutex);
+	batch_buf.reset(size ? new char[size] : nullptr);
+	batch_size = size;
+	batch_ms = interval_ms ? interval_ms : 1;
+	batch_used = 0;
+}
+
+// Установка политики сброса данных на диск
+void Logging::set_sync(uint8_t policy, uint32_t interval_ms)
+{
+	std::lock_guard<std::recursive_timed_mutex> lock(log_file_mutex);
+	sync_policy = policy;
+	sync_ms = interval_ms ? interval_ms : 1;
+	synced_at = std::chrono::steady_clock::now();
+
+	// Поток ротации обслуживает файл, открытый до изменения политики
+	if(log_fd >= 0 && service_period()) start_rotation();
+}
+
+// Отправка данных, накопленных очередью io_uring, без ожидания записи
+void Logging::submit_file() const
+{
+	std::lock_guard<std::recursive_timed_mutex> lock(log_file_mutex);
+	if(uring) uring->submit();
+}
+
+// Ожидание завершения записи данных, переданных очереди io_uring
+void Logging::drain_file() const
+{
+	std::lock_guard<std::recursive_timed_mutex> lock(log_file_mutex);
+	if(uring) uring->drain();
+}
+
+// Получение лог-файла для записи данных длиной need Байт: открытие при первом обращении
+// и переключение на следующий файл при превышении максимального размера
+int Logging::open_file(size_t need) const
+{
+	if(log_fd < 0){
+		log_fd = open_log(sets.log_fname.c_str(), false, log_map, log_fsize);
+		if(log_fd < 0) return -1;
+		if(uring_mode){
+			if(!uring) uring.reset(new log_uring(uring_sync));
+			uring->attach(log_fd, log_fsize);
+		}
+		if(binary) begin_binary_session();
+		{
+			std::lock_guard<std::mutex> handoff(handoff_mutex);
+			handoff_open = true;
+		}
+		// Накопленные записи и сброс на диск по времени обслуживаются потоком ротации
+		if(service_period()) start_rotation();
+	}
+
+	// Следующий файл готовится заранее - по заполнении половины текущего
+	if(!next_requested.load(std::memory_order_relaxed) && log_fsize >= sets.log_max_fsize / 2){
+		next_requested.store(true, std::memory_order_relaxed);
+		request_rotation();
+	}
+
+	// Отображенный файл заполнен, если в нем не помещаются очередные данные
+	bool full = log_map ? (log_fsize + need > sets.log_max_fsize) : (log_fsize >= sets.log_max_fsize);
+	if(!full) return log_fd;
+
+	// Пока следующий файл не готов, запись продолжается в текущий (превышение размера ограничено, см. write_locked()).
+	// Готовый следующий файл забирается только пишущим потоком под блокировкой лог-файла
+	{
+		std::lock_guard<std::mutex> handoff(handoff_mutex);
+		if(next_fd < 0) return log_fd;
+	}
+
+	// Накопленные записи дописываются в заполненный файл, данные io_uring записываются до его закрытия
+	if(batch_used) flush_batch();
+	if(uring) uring->drain();
+	{
+		std::lock_guard<std::mutex> handoff(handoff_mutex);
+		retired_fd = log_fd;
+		retired_map = log_map;
+		retired_size = log_fsize;
+		log_fd = next_fd;
+		log_map = next_map;
+		next_fd = -1;
+		next_map = nullptr;
+	}
+	log_fsize = 0;
+	if(uring) uring->attach(log_fd, 0);
+	stats_block::add(local_stats().rotations);
+
+	if(binary){
+		begin_binary_session();
+	}
+	else{
+		static const char rotated[] = " ----- Log file has been rotated -----\n";
+		char rec[LOG_STAMP_MAX_LEN + sizeof rotated];
+		size_t len = Logging::make_msg_stamp(rec, LOG_STAMP_MAX_LEN, stamp_type, sets.mod_name, stamp_fmt);
+		std::memcpy(rec + len, rotated, sizeof(rotated) - 1);
+		append(rec, len + sizeof(rotated) - 1);
+	}
+
+	// Переименование файлов и подготовка следующего выполняются потоком ротации
+	request_rotation();
+	return log_fd;
+}
+
+// Постановка задачи потоку ротации (поток запускается при первом обращении)
+void Logging::request_rotation() const
+{
+	std::lock_guard<std::mutex> lock(rotate_mutex);
+
+	if(!rotate_thread.joinable()){
+		rotate_stop = false;
+		rotate_thread = std::thread(&Logging::rotate_worker, this);
+	}
+
+	rotate_pending = true;
+	rotate_cv.notify_all();
+}
+
+// Запуск потока ротации без задачи (для периодического обслуживания лог-файла)
+void Logging::start_rotation() const
+{
+	std::lock_guard<std::mutex> lock(rotate_mutex);
+
+	if(!rotate_thread.joinable()){
+		rotate_stop = false;
+		rotate_thread = std::thread(&Logging::rotate_worker, this);
+	}
+}
+
+// Ожидание завершения поставленной задачи ротации
+void Logging::wait_rotation() const
+{
+	if(std::this_thread::get_id() == rotate_thread.get_id()) return;
+
+	std::unique_lock<std::mutex> lock(rotate_mutex);
+	rotate_cv.wait(lock, [this]{ return !rotate_pending && !rotate_busy; });
+}
+
+// Ожидание завершения задачи ротации не дольше timeout. false - задача не завершена
+bool Logging::wait_rotation(std::chrono::milliseconds timeout) const
+{
+	if(std::this_thread::get_id() == rotate_thread.get_id()) return false;
+
+	std::unique_lock<std::mutex> lock(rotate_mutex);
+	return rotate_cv.wait_for(lock, timeout, [this]{ return !rotate_pending && !rotate_busy; });
+}
+
+// Завершение потока ротации (после выполнения поставленной задачи)
+void Logging::stop_rotation()
+{
+	{
+		std::lock_guard<std::mutex> lock(rotate_mutex);
+		if(!rotate_thread.joinable()) return;
+		rotate_stop = true;
+	}
+	rotate_cv.notify_all();
+	rotate_thread.join();
+}
+
+// Поток ротации лог-файла
+void Logging::rotate_worker() const
+{
+	std::unique_lock<std::mutex> lock(rotate_mutex);
+
+	for(;;){
+		// При пакетной записи и сбросе на диск по времени ожидание ограничено периодом обслуживания файла
+		auto has_task = [this]{ return rotate_pending || rotate_stop; };
+		uint32_t period = service_period();
+		if(!period) rotate_cv.wait(lock, has_task);
+		else if(!rotate_cv.wait_for(lock, std::chrono::milliseconds(period), has_task)){
+			lock.unlock();
+			service_file();
+			lock.lock();
+			continue;
+		}
+		if(!rotate_pending) break;
+
+		rotate_pending = false;
+		rotate_busy = true;
+		lock.unlock();
+
+		int old_fd;
+		char *old_map;
+		uint64_t old_size;
+		{
+			std::lock_guard<std::mutex> handoff(handoff_mutex);
+			old_fd = retired_fd;
+			old_map = retired_map;
+			old_size = retired_size;
+			retired_fd = -1;
+			retired_map = nullptr;
+		}
+		if(old_fd >= 0) finish_rotation(old_fd, old_map, old_size);
+		prepare_next_file();
+
+		lock.lock();
+		rotate_busy = false;
+		rotate_cv.notify_all();
+	}
+}
+
+// Завершение ротации после переключения на следующий файл: колбек, создание бэкапа
+// заполненного файла и переименование следующего файла в основной
+void Logging::finish_rotation(int old_fd, char *old_map, uint64_t old_size) const
+{
+	// Данные io_uring записаны пишущим потоком при переключении файла (см. open_file())
+	close_log(old_fd, old_map, old_size);
+
+	std::string rotate_err;
+	if(log_rotate) {
+		try{
+			log_rotate(log_rotate_arg);
+		}
+		catch(const std::exception &e){
+			rotate_err = e.what();
+		}
+	}
+
+	// Процедура создания бэкапа лог-файла (более старый бэкап с тем же номером заменяется).
+	// Старый бэкап удаляется заранее: замена файла переименованием в ext4 (auto_da_alloc)
+	// запускает запись данных переименованного файла на диск и задерживает подготовку следующего
+	char name[PATH_MAX];
+	if(sets.max_files_num){
+		::unlink(backup_file_name(name, curr_file_num));
+		std::rename(sets.log_fname.c_str(), name);
+		curr_file_num = (curr_file_num >= sets.max_files_num) ? 1 : curr_file_num + 1;
+	}
+
+	// Запись в открытый файл продолжается и после переименования
+	std::rename(next_file_name(name), sets.log_fname.c_str());
+
+	log_limit::hold hold;
+	msg(MSG_VERBOSE, "------ Rotated '%s' file ------\n", sets.log_fname);
+	if(!rotate_err.empty()) msg(MSG_ERROR, "log_rotate() failed: %s\n", rotate_err);
+}
+
+// Заблаговременное открытие следующего лог-файла
+void Logging::prepare_next_file() const
+{
+	{
+		std::lock_guard<std::mutex> handoff(handoff_mutex);
+		// Пока заполненный файл ожидает ротации, имя следующего файла занято текущим
+		if(next_fd >= 0 || !handoff_open || retired_fd >= 0) return;
+	}
+
+	char name[PATH_MAX];
+	char *map;
+	uint64_t used;
+	int fd = open_log(next_file_name(name), true, map, used);
+
+	std::lock_guard<std::mutex> handoff(handoff_mutex);
+
+	// Ошибка открытия: повторная попытка при следующей записи
+	if(fd < 0){
+		next_requested.store(false, std::memory_order_relaxed);
+		return;
+	}
+
+	// Лог-файл закрыт, пока открывался следующий
+	if(!handoff_open){
+		close_log(fd, map, 0);
+		::unlink(name);
+		return;
+	}
+
+	next_fd = fd;
+	next_map = map;
+}
+
+// Начало сессии бинарного лог-файла: заголовок и определения всех известных строк
+// (выполняется при захваченной блокировке лог-файла)
+void Logging::begin_binary_session() const
+{
+	log_buf &out = session_buf;
+	out.clear();
+	out.push_back((char)log_bin::rec_session);
+	out.append(log_bin::magic, sizeof(log_bin::magic));
+	out.push_back((char)log_bin::version);
+	bin_defined = log_bin::registry::instance().dump(out);
+
+	append(out.data(), out.size());
+}
+
+// Подготовка в define_buf определений строк реестра, добавленных после начала сессии бинарного
+// лог-файла (выполняется при захваченной блокировке лог-файла). Возвращает размер определений
+size_t Logging::bin_defines() const
+{
+	auto &reg = log_bin::registry::instance();
+	define_buf.clear();
+	define_from = bin_defined;
+	define_num = reg.count();
+	if(define_num > define_from) reg.dump(define_buf, define_from, define_num);
+	return define_buf.size();
+}
+
+// Кодирование заголовка сообщения бинарного режима (определения новых строк выводятся при записи в файл)
+void Logging::bin_header(log_bin::writer &w, const std::string &mod, log_lvl_t flags, stamp_t stamp, const char *fmt) const
+{
+	auto &reg = log_bin::registry::instance();
+	bool fmt_added = false, mod_added = false, stamp_added = false;
+
+	uint32_t fmt_id = reg.intern_fmt(fmt, fmt_added);
+	uint32_t mod_id = reg.intern_module(mod, mod_added);
+	uint32_t stamp_id = (stamp == custom) ? reg.intern_fmt(stamp_fmt, stamp_added) : 0;
+
+	struct timespec spec;
+	clock_gettime(CLOCK_REALTIME, &spec);
+
+	w.u8(log_bin::rec_message);
+	w.u8(flags);
+	w.u8((uint8_t)stamp);
+
+	w.varint(fmt_id);
+	if(!fmt_id) w.str(fmt, std::strlen(fmt));
+	w.varint(mod_id);
+	if(!mod_id) w.str(mod.data(), mod.size());
+	if(stamp == custom){
+		w.varint(stamp_id);
+		if(!stamp_id) w.str(stamp_fmt, std::strlen(stamp_fmt));
+	}
+
+	w.varint((uint64_t)spec.tv_sec);
+	w.varint((uint64_t)spec.tv_nsec);
+}
+
+// Запись сформированного бинарного сообщения
+int Logging::write_binary(log_lvl_t flags, const char *rec, size_t len) const
+{
+	if(async_q){
+		this->enqueue(dest_file | dest_lvl(flags), rec, len);
+		return (int)len;
+	}
+
+	int ret = write_file(rec, len, flags & LOG_LVL_BIT_MASK);
+	if(drops_pending.load(std::memory_order_relaxed)) report_drops();
+	return ret;
+}
+
+// Начало структурированного события (событие, не прошедшее проверку уровня, пустое)
+log_event Logging::start_event(const log_module *mod, log_lvl_t flags, const char *name) const
+{
+	if(!log_lvl_compiled(flags)) return log_event();
+
+	log_lvl_t curr_lvl = lvl_of(mod);
+	if(!passes(flags, curr_lvl)) return log_event();
+
+	if(binary){
+		if(sets.log_fname == "" || !sets.log_max_fsize) return log_event();
+		return log_event(this, name_of(mod), flags, 0, name);
+	}
+
+	uint8_t dest = dest_of(flags, curr_lvl);
+	return dest ? log_event(this, name_of(mod), flags, dest, name) : log_event();
+}
+
+// Начало записи события: в текстовом режиме - объект JSON, в бинарном - заголовок записи события
+log_event::log_event(const Logging *log, const std::string &mod, log_lvl_t flags, uint8_t dest, const char *name):
+	log(log), flags(flags), dest(dest)
+{
+	if(!name) name = "";
+
+	struct timespec spec;
+	clock_gettime(CLOCK_REALTIME, &spec);
+
+	stage.emplace();
+	log_buf &rec = stage->buf();
+
+	if(dest){
+		log_json::put_head(rec, spec, flags & LOG_LVL_BIT_MASK, mod, name);
+		return;
+	}
+
+	// Бинарная запись кодируется непосредственно в буфер потока (его память сохраняется между записями)
+	w = log_bin::writer(rec.tail(LOG_RECORD_MAX_LEN), LOG_RECORD_MAX_LEN);
+
+	auto &reg = log_bin::registry::instance();
+	bool name_added = false, mod_added = false;
+	uint32_t name_id = reg.intern_fmt(name, name_added);
+	uint32_t mod_id = reg.intern_module(mod, mod_added);
+
+	w.u8(log_bin::rec_event);
+	w.u8(flags);
+	w.varint(name_id);
+	if(!name_id) w.str(name, std::strlen(name));
+	w.varint(mod_id);
+	if(!mod_id) w.str(mod.data(), mod.size());
+	w.varint((uint64_t)spec.tv_sec);
+	w.varint((uint64_t)spec.tv_nsec);
+
+	// Число полей записывается при завершении события
+	count_pos = w.size();
+	w.u8(0);
+}
+
+// Завершение события и вывод записи
+void log_event::finish()
+{
+	// Число пропущенных в месте вызова записей (см. log_limit) - отдельным полем
+	if(uint64_t n = log_limit::take(nullptr)) kv("suppressed", n);
+
+	log_buf &rec = stage->buf();
+
+	if(dest){
+		log_json::put_tail(rec);
+		log->count_emitted(flags);
+		log->write_record(dest, rec.data(), rec.size());
+		return;
+	}
+
+	if(!w.ok()){
+		log->count_dropped(Logging::stats_t::drop_too_long);
+		return;
+	}
+
+	// Буфер потока пуст до фиксации записи - ее начало совпадает с концом буфера
+	char *bin = rec.tail(0);
+	bin[count_pos] = (char)fields;
+	rec.commit(w.size());
+
+	log->count_emitted(flags);
+	log->write_binary(flags, rec.data(), rec.size());
+}
+
+// Закрытие лог-файла (будет открыт заново при следующей записи)
+void Logging::close_file() const
+{
+	// Незавершенная ротация выполняется до закрытия файла
+	wait_rotation();
+
+	std::unique_lock<std::recursive_timed_mutex> lock(log_file_mutex);
+
+	// Отложенные при перегрузке записи выводятся в закрываемый файл
+	if(backlog_num.load(std::memory_order_relaxed)) drain_backlog(lock);
+	if(!lock.owns_lock()) lock.lock();
+
+	// Переключение файла произошло после ожидания - ротация завершается здесь
+	int old_fd;
+	char *old_map;
+	{
+		std::lock_guard<std::mutex> handoff(handoff_mutex);
+		old_fd = retired_fd;
+		old_map = retired_map;
+		retired_fd = -1;
+		retired_map = nullptr;
+		handoff_open = false;
+	}
+	if(old_fd >= 0) finish_rotation(old_fd, old_map, retired_size);
+	// Очередь io_uring завершает запись переданных данных при уничтожении
+	uring.reset();
+	if(log_fd >= 0 && batch_used) flush_batch();
+	if(log_fd >= 0 && (sync_policy != sync_never) && sync_dirty) sync_file();
+	if(log_fd >= 0) close_log(log_fd, log_map, log_fsize);
+	log_fd = -1;
+	log_map = nullptr;
+	std::lock_guard<std::mutex> handoff(handoff_mutex);
+	if(next_fd >= 0){
+		close_log(next_fd, next_map, 0);
+		char name[PATH_MAX];
+		::unlink(next_file_name(name));
+	}
+	next_fd = -1;
+	next_map = nullptr;
+	next_requested.store(false, std::memory_order_relaxed);
+	log_fsize = 0;
+}
+
+// Запись в лог-файл сформированной записи
+int Logging::write_file(const char *rec, size_t len, log_lvl_t lvl) const
+{
+	if( sets.log_fname == "" || !sets.log_max_fsize ) return 0;
+
+	stats_block &st = local_stats();
+
+	// Ожидание блокировки измеряется только при занятом файле
+	std::unique_lock<std::recursive_timed_mutex> lock(log_file_mutex, std::defer_lock);
+	if(lock.try_lock()){
+		stats_block::hist(st.lock_wait, 0);
+	}
+	else{
+		auto start = std::chrono::steady_clock::now();
+		bool locked = true;
+		overload_t policy = overload.load(std::memory_order_relaxed);
+		if(policy == overload_block) lock.lock();
+		else locked = lock.try_lock_for(std::chrono::milliseconds(LOG_FILE_LOCK_MS));
+		stats_block::hist(st.lock_wait, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		if(!locked) return overloaded(dest_file | dest_lvl(lvl), rec, len, stats_t::drop_lock_timeout);
+		if(policy == overload_block) stats_block::add(st.overload[overload_block]);
+	}
+
+	// Отложенные записи выводятся раньше текущей. В асинхронном режиме текущая запись взята из очереди
+	// и старше отложенных - они выводятся потоком вывода после опустошения очереди
+	if(!async_q && backlog_num.load(std::memory_order_relaxed)) drain_backlog(lock);
+
+	return write_locked(lock, rec, len, lvl);
+}
+
+// Запись при захваченной блокировке лог-файла (в режиме mapped блокировка может временно освобождаться)
+int Logging::write_locked(std::unique_lock<std::recursive_timed_mutex> &lock, const char *rec, size_t len, log_lvl_t lvl) const
+{
+	if(!lock.owns_lock()) return 0;
+
+	// Запись длиннее отображенного файла не может быть размещена ни в одном файле
+	if(mapped && len > sets.log_max_fsize){
+		count_dropped(stats_t::drop_too_long);
+		return 0;
+	}
+
+	// Определения строк, добавленных в реестр после начала сессии бинарного лог-файла, выводятся
+	// перед записью: строка считается определенной в сессии только после вывода ее определения
+	size_t need = len + (binary ? bin_defines() : 0);
+
+	if(open_file(need) < 0){
+		count_dropped(stats_t::drop_open_failed);
+		return 0;
+	}
+
+	// Лог-файл заполнен (отображенный - полностью, обычный - с превышением LOG_FILE_OVERSHOOT),
+	// а следующий еще не подготовлен: ожидание потока ротации (всего не дольше времени ожидания блокировки файла).
+	// Пока блокировка освобождена, другой поток может переключить и заполнить следующий файл - ожидание повторяется
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(LOG_FILE_LOCK_MS);
+	while(over_limit(need)){
+		lock.unlock();
+		auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		bool ready = left.count() > 0 && wait_rotation(left);
+		if(!ready || !lock.try_lock_until(deadline)){
+			count_dropped(stats_t::drop_no_space);
+			return 0;
+		}
+		if(open_file(need) < 0){
+			count_dropped(stats_t::drop_open_failed);
+			return 0;
+		}
+	}
+
+	if(binary){
+		// Новая сессия (ротация) или определения выведены другим потоком, пока блокировка была освобождена
+		if(define_from != bin_defined) bin_defines();
+		size_t n = define_buf.size();
+		if(n && append(define_buf.data(), n) == n) bin_defined = define_num;
+	}
+
+	// Записи уровня MSG_ERROR выводятся (и при политике sync_error сбрасываются на диск) сразу
+	bool urgent = (lvl == MSG_ERROR);
+	stats_block &st = local_stats();
+	auto start = std::chrono::steady_clock::now();
+	size_t ret = append(rec, len, urgent);
+	if(urgent && (sync_policy & sync_error)) sync_file();
+	stats_block::hist(st.write_time, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	if(ret < len) count_dropped(stats_t::drop_write_failed);
+	else stats_block::add(st.records_file);
+
+	return (int)ret;
+}
+
+// Обработка записи, не выведенной из-за перегрузки, согласно политике
+int Logging::overloaded(uint8_t dest, const char *rec, size_t len, stats_t::drop_t reason) const
+{
+	overload_t policy = overload.load(std::memory_order_relaxed);
+	stats_block::add(local_stats().overload[policy]);
+
+	if(policy != overload_drop_oldest && policy != overload_spill){
+		count_dropped(reason);
+		return 0;
+	}
+
+	bool accepted;
+	size_t dropped;
+	{
+		std::lock_guard<std::mutex> lock(backlog_mutex);
+		dropped = backlog.push(dest, rec, len, accepted);
+		backlog_num.store(backlog.size(), std::memory_order_relaxed);
+	}
+	for(size_t i = 0; i < dropped; ++i) count_dropped(stats_t::drop_overflow);
+
+	return accepted ? (int)len : 0;
+}
+
+// Вывод отложенных записей. Буфер забирается целиком, чтобы не задерживать откладывающие потоки
+void Logging::drain_backlog(std::unique_lock<std::recursive_timed_mutex> &lock) const
+{
+	while(lock.owns_lock()){
+		{
+			std::lock_guard<std::mutex> guard(backlog_mutex);
+			if(backlog.empty()) return;
+			backlog_out.swap(backlog);
+			backlog_num.store(0, std::memory_order_relaxed);
+		}
+
+		uint8_t dest;
+		const char *rec;
+		size_t len;
+		while(backlog_out.front(dest, rec, len)){
+			if(dest & dest_stdout) write_stdout(rec, len);
+			if(dest & dest_sinks) write_sinks(dest, rec, len);
+			if(dest & dest_file) write_locked(lock, rec, len, dest >> dest_lvl_shift);
+			backlog_out.pop();
+		}
+	}
+}
+
+// Сообщение о потерянных записях: выводится следующим после потерь сообщением, не чаще LOG_DROP_REPORT_MS
+void Logging::report_drops() const
+{
+	int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	int64_t last = drops_reported.load(std::memory_order_relaxed);
+	if(now - last < LOG_DROP_REPORT_MS) return;
+	if(!drops_reported.compare_exchange_strong(last, now, std::memory_order_relaxed)) return;
+
+	log_limit::hold hold;
+	uint64_t n = drops_pending.exchange(0, std::memory_order_relaxed);
+	if(n) msg(MSG_WARNING | MSG_TO_FILE, "%llu messages dropped\n", (unsigned long long)n);
+}
+
+// Установка политики перегрузки
+void Logging::set_overload(overload_t policy, size_t size)
+{
+	if(!size) size = (policy == overload_spill) ? LOG_SPILL_MAX_SIZE : LOG_BACKLOG_SIZE;
+
+	std::lock_guard<std::mutex> lock(backlog_mutex);
+	overload.store(policy, std::memory_order_relaxed);
+	queue_overload.store(policy != overload_block, std::memory_order_relaxed);
+	backlog.reset(size, policy == overload_drop_oldest);
+}
+
+// Текст записи по строке формата места вызова, заданной во время выполнения: префикс места вызова,
+// сообщение (последние suffix_args аргументов выводятся по suffix)
+void Logging::format_site(log_buf &out, const log_site_rt &fmt, const log_fmt::arg_ref *args, size_t nargs)
+{
+	out.append(fmt.prefix, fmt.site.plain_len);
+
+	size_t n = (nargs > fmt.suffix_args) ? nargs - fmt.suffix_args : 0;
+	if(n) log_fmt::format_runtime(out, fmt.fmt, args, n);
+	else out.append(fmt.fmt, fmt.len);
+
+	if(fmt.suffix) log_fmt::format_runtime(out, fmt.suffix, args + n, nargs - n);
+}
+
+// Число пропущенных записей дописывается перед завершающим переводом строки
+void Logging::add_suppressed(log_buf &rec, const log_site *site)
+{
+	uint64_t n = log_limit::take(site ? site->limit : nullptr);
+	if(!n) return;
+
+	bool nl = !rec.empty() && rec.data()[rec.size() - 1] == '\n';
+	if(nl) rec.truncate(rec.size() - 1);
+	log_fmt::format(rec, LOG_FMT(" [%llu suppressed]"), (unsigned long long)n);
+	if(nl) rec.push_back('\n');
+}
+
+// Вывод записи в терминал одним write() (с подсветкой - одним writev(): префикс записи
+// без подсветки заменяется префиксом с подсветкой без копирования записи)
+void Logging::write_stdout(const char *rec, size_t len, const rec_color *color) const
+{
+	size_t ret;
+	if(color){
+		size_t rest = color->at + color->plain_len;
+		struct iovec iov[3] = {
+			{const_cast<char*>(rec), color->at},
+			{const_cast<char*>(color->text), color->len},
+			{const_cast<char*>(rec + rest), len - rest}
+		};
+		len += color->len - color->plain_len;
+		ret = writev_all(console_fd, iov, 3);
+	}
+	else ret = write_all(console_fd, rec, len);
+
+	stats_block &st = local_stats();
+	stats_block::add(st.bytes_stdout, ret);
+	if(ret < len) stats_block::add(st.dropped[stats_t::drop_write_failed]);
+}
+
+// Проверка терминала (errno сохраняется - проверка не должна влиять на logging_perr)
+bool Logging::is_tty(int fd)
+{
+	int err = errno;
+	bool tty = ::isatty(fd) == 1;
+	errno = err;
+	return tty;
+}
+
+// Установка дескриптора вывода в терминал и режима подсветки
+void Logging::set_console(int fd, color_t mode)
+{
+	flush();
+	console_fd = fd;
+	console_color = (mode == color_always) || (mode == color_auto && is_tty(fd));
+}
+
+// Вывод записи в дополнительные приемники, уровень которых не ниже уровня сообщения
+void Logging::write_sinks(uint8_t dest, const char *rec, size_t len) const
+{
+	log_lvl_t msg_lvl = dest >> dest_lvl_shift;
+	auto list = std::atomic_load(&sinks);
+	if(!list) return;
+	for(auto &sink: *list){
+		if(sink->accepts(msg_lvl)) sink->write(msg_lvl, rec, len);
+	}
+}
+
+// Изменение состава приемников: новый список публикуется целиком, потоки, выводящие запись,
+// дорабатывают со снимком прежнего списка (приемник освобождается после последнего снимка)
+void Logging::add_sink(std::shared_ptr<log_sink> sink)
+{
+	if(!sink) return;
+
+	std::lock_guard<std::mutex> lock(sinks_mutex);
+	auto list = std::make_shared<sink_list>();
+	if(auto old = std::atomic_load(&sinks)) *list = *old;
+	list->push_back(std::move(sink));
+	std::atomic_store(&sinks, std::shared_ptr<const sink_list>(std::move(list)));
+	log_sink::changed();
+}
+
+void Logging::remove_sink(const std::shared_ptr<log_sink> &sink)
+{
+	// Записи очереди асинхронного режима выводятся до отключения приемника
+	flush();
+
+	std::lock_guard<std::mutex> lock(sinks_mutex);
+	auto list = std::make_shared<sink_list>();
+	if(auto old = std::atomic_load(&sinks)){
+		for(auto &s: *old) if(s != sink) list->push_back(s);
+	}
+	std::atomic_store(&sinks, std::shared_ptr<const sink_list>(std::move(list)));
+	log_sink::changed();
+}
+
+void Logging::clear_sinks()
+{
+	flush();
+
+	std::lock_guard<std::mutex> lock(sinks_mutex);
+	std::atomic_store(&sinks, std::shared_ptr<const sink_list>());
+	log_sink::changed();
+}
+
+// Счетчик изменений считывается до снимка списка: изменение, произошедшее во время расчета,
+// приведет к повторному расчету при следующей проверке. Расчеты выполняются по очереди,
+// чтобы результат по устаревшему снимку не заменил более новый
+void Logging::update_sinks_lvl() const
+{
+	std::lock_guard<std::mutex> lock(sinks_mutex);
+	uint32_t epoch = log_sink::epoch();
+	if(sinks_epoch.load(std::memory_order_relaxed) == epoch) return;
+
+	log_lvl_t lvl = 0;
+	if(auto list = std::atomic_load(&sinks)){
+		for(auto &s: *list) lvl = std::max(lvl, s->get_lvl());
+	}
+	sinks_lvl.store(lvl, std::memory_order_relaxed);
+	sinks_epoch.store(epoch, std::memory_order_release);
+}
+
+// Вывод сформированной записи в stdout, дополнительные приемники и (или) лог-файл
+void Logging::write_record(uint8_t dest, const char *rec, size_t len, const rec_color *color) const
+{
+	if(async_q){
+		// Запись с подсветкой для терминала и запись без подсветки для файла и приемников
+		// помещаются в очередь отдельно
+		const uint8_t out = dest_file | dest_sinks;
+		if(color && (dest & dest_stdout) && (dest & out)){
+			this->enqueue(dest & ~dest_stdout, rec, len);
+			this->enqueue(dest & ~out, rec, len, color);
+		}
+		else this->enqueue(dest, rec, len, color);
+		return;
+	}
+
+	// Запись выводится одним write() - строки разных потоков не перемешиваются без общей блокировки
+	if(dest & dest_stdout) write_stdout(rec, len, color);
+	if(dest & dest_sinks) write_sinks(dest, rec, len);
+	if(dest & dest_file) this->write_file(rec, len, dest >> dest_lvl_shift);
+
+	if(drops_pending.load(std::memory_order_relaxed)) report_drops();
+}
+
+// Включение (выключение) асинхронного режима
+void Logging::set_async(bool enable, size_t queue_size)
+{
+	if(enable == is_async()) return;
+
+	if(enable){
+		async_q.reset(new log_ring(queue_size));
+		async_stop = false;
+		async_thread = std::thread(&Logging::async_writer, this);
+		return;
+	}
+
+	// Завершение потока вывода после опустошения очереди
+	{
+		std::lock_guard<std::mutex> lock(async_mutex);
+		async_stop = true;
+	}
+	async_cv.notify_one();
+	async_thread.join();
+	async_q.reset();
+}
+
+// Ожидание вывода всех сообщений, помещенных в очередь к моменту вызова
+void Logging::flush() const
+{
+	if(async_q && std::this_thread::get_id() != async_thread.get_id()){
+		uint64_t target = async_q->head();
+		std::unique_lock<std::mutex> lock(async_mutex);
+		async_cv.notify_one();
+		flush_cv.wait(lock, [this, target]{ return async_q->tail() >= target; });
+	}
+	else std::fflush(stdout);
+
+	if(auto list = std::atomic_load(&sinks)){
+		for(auto &sink: *list) sink->flush();
+	}
+
+	if(backlog_num.load(std::memory_order_relaxed)){
+		std::unique_lock<std::recursive_timed_mutex> lock(log_file_mutex);
+		drain_backlog(lock);
+	}
+
+	if(batch_size){
+		std::lock_guard<std::recursive_timed_mutex> lock(log_file_mutex);
+		if(log_fd >= 0 && batch_used) flush_batch();
+	}
+
+	if(uring_mode) drain_file();
+}
+
+// Помещение сформированной записи в очередь асинхронного режима
+void Logging::enqueue(uint8_t dest, const char *rec, size_t len, const rec_color *color) const
+{
+	len = std::min(len, async_q->max_record());
+
+	// Запись для терминала с подсветкой помещается в очередь по частям: префикс заменяется при копировании
+	log_ring::part parts[3] = {{rec, len}};
+	size_t n = 1;
+	if(color && len >= color->at + color->plain_len){
+		size_t rest = color->at + color->plain_len;
+		parts[0] = {rec, color->at};
+		parts[1] = {color->text, color->len};
+		parts[2] = {rec + rest, len - rest};
+		n = 3;
+	}
+	else color = nullptr;
+
+	bool blocked = false;
+	while(!async_q->try_push(dest, parts, n)){
+		// Поток вывода не может ожидать сам себя (например, сообщения о ротации файла)
+		if(std::this_thread::get_id() == async_thread.get_id()){
+			if(dest & dest_stdout) write_stdout(rec, len, color);
+			if(dest & dest_sinks) write_sinks(dest, rec, len);
+			if(dest & dest_file) write_file(rec, len, dest >> dest_lvl_shift);
+			return;
+		}
+		// Очередь заполнена: ожидание освобождения места (по умолчанию) или применение заданной политики перегрузки
+		async_cv.notify_one();
+		if(queue_overload.load(std::memory_order_relaxed)){
+			overloaded(dest, rec, len, stats_t::drop_queue_full);
+			wake_writer();
+			return;
+		}
+		if(!blocked) stats_block::add(local_stats().overload[overload_block]);
+		blocked = true;
+		std::this_thread::yield();
+	}
+
+	wake_writer();
+}
+
+// Поток вывода будится только если он ожидает новых сообщений. Барьеры в wake_writer() и async_writer()
+// гарантируют, что либо поток вывода увидит новую запись, либо записавший поток увидит async_idle
+// и оповестит его под мьютексом (оповещение не может прийти между проверкой очереди и ожиданием)
+void Logging::wake_writer() const
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(!async_idle.load(std::memory_order_relaxed)) return;
+
+	std::lock_guard<std::mutex> lock(async_mutex);
+	async_cv.notify_one();
+}
+
+// Поток вывода сообщений асинхронного режима
+void Logging::async_writer()
+{
+	uint8_t dest;
+	const char *rec;
+	size_t len;
+
+	for(;;){
+		bool written = false;
+
+		// Каждая запись выводится целиком одним write()
+		while(async_q->front(dest, rec, len)){
+			if(dest & dest_stdout) write_stdout(rec, len);
+			if(dest & dest_sinks) write_sinks(dest, rec, len);
+			if(dest & dest_file) write_file(rec, len, dest >> dest_lvl_shift);
+			async_q->release();
+			written = true;
+		}
+
+		// Записи, отложенные при заполнении очереди, выводятся после опустошения очереди
+		if(backlog_num.load(std::memory_order_relaxed)){
+			std::unique_lock<std::recursive_timed_mutex> file_lock(log_file_mutex);
+			drain_backlog(file_lock);
+			written = true;
+		}
+		if(drops_pending.load(std::memory_order_relaxed)) report_drops();
+
+		// Перед ожиданием новых сообщений накопленные данные передаются ядру
+		if(written && uring_mode) submit_file();
+
+		std::unique_lock<std::mutex> lock(async_mutex);
+		if(written) flush_cv.notify_all();
+		if(async_stop && async_q->empty()) break;
+
+		// Ожидание новых сообщений или отложенных записей (см. wake_writer()). Ограничено по времени,
+		// только если есть потерянные записи, сообщение о которых еще не выведено (см. report_drops())
+		async_idle.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto ready = [this]{ return !async_q->empty() || backlog_num.load(std::memory_order_relaxed) || async_stop; };
+		if(drops_pending.load(std::memory_order_relaxed)) async_cv.wait_for(lock, std::chrono::milliseconds(LOG_DROP_REPORT_MS), ready);
+		else async_cv.wait(lock, ready);
+		async_idle.store(false, std::memory_order_relaxed);
+	}
+
+	flush_cv.notify_all();
+}
+
+// Включение (выключение) бортового самописца
+void Logging::set_recorder(size_t slots, log_lvl_t lvl)
+{
+	for(auto &r: recorders){
+		const Logging *self = this;
+		r.compare_exchange_strong(self, nullptr);
+	}
+	recorder = nullptr;
+	rec_slots.reset();
+	if(!slots) return;
+
+	size_t n = 2;
+	while(n < slots) n <<= 1;
+	rec_slots.reset(new rec_slot[n]);
+	rec_mask = n - 1;
+	rec_lvl = lvl;
+	rec_pos.store(0, std::memory_order_relaxed);
+
+	std::string path = (sets.log_fname != "" ? sets.log_fname : std::string("logger")) + ".flight";
+	std::snprintf(rec_path, sizeof rec_path, "%s", path.c_str());
+	std::snprintf(rec_mod, sizeof rec_mod, "%s", sets.mod_name.c_str());
+
+	recorder = rec_slots.get();
+	for(auto &r: recorders){
+		const Logging *none = nullptr;
+		if(r.compare_exchange_strong(none, this)) break;
+	}
+}
+
+// Захват очередной записи самописца (самая старая запись перезаписывается)
+Logging::rec_slot& Logging::rec_begin(uint64_t &pos) const
+{
+	pos = rec_pos.fetch_add(1, std::memory_order_relaxed);
+	rec_slot &slot = recorder[pos & rec_mask];
+	slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	return slot;
+}
+
+// Публикация записи самописца с позиции pos. Аргументы, не поместившиеся в запись, не сохраняются
+void Logging::rec_commit(rec_slot &slot, uint64_t pos, log_lvl_t flags, stamp_t stamp, log_bin::writer &w, const char *fmt) const
+{
+	size_t len = w.size();
+	if(!w.ok()){
+		log_bin::writer t(slot.data, sizeof slot.data);
+		if(!slot.fmt) t.str(fmt, std::min(std::strlen(fmt), sizeof(slot.data) - 8));
+		slot.fmt_end = (uint16_t)t.size();
+		t.u8(0);
+		len = t.size();
+	}
+
+	// Грубые часы (разрешение - период системного таймера) в несколько раз дешевле точных,
+	// порядок сообщений определяется позицией записи
+	clock_gettime(CLOCK_REALTIME_COARSE, &slot.spec);
+	slot.flags = flags;
+	slot.stamp = (uint8_t)stamp;
+	slot.len = (uint16_t)len;
+
+	// Запись, захваченная другим потоком после перехода кольца через нее, не публикуется:
+	// ее содержимое перезаписывается, а готовой ее объявит захвативший поток
+	uint64_t seq = 2 * pos + 1;
+	slot.seq.compare_exchange_strong(seq, 2 * pos + 2, std::memory_order_release, std::memory_order_relaxed);
+}
+
+// Вывод самописца: только системные вызовы и буфер на стеке (безопасно для обработчика сигнала).
+// Записи, изменяемые во время чтения, пропускаются
+bool Logging::dump_recorder(const char *path) const
+{
+	const rec_slot *slots = recorder;
+	if(!slots) return false;
+
+	int fd = ::open(path ? path : rec_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0) return false;
+
+	char buf[4096];
+	size_t used = 0;
+	auto put = [&](const char *p, size_t n){
+		if(used + n > sizeof buf){
+			write_all(fd, buf, used);
+			used = 0;
+		}
+		std::memcpy(buf + used, p, n);
+		used += n;
+	};
+
+	char hdr[8];
+	hdr[0] = (char)log_bin::rec_session;
+	std::memcpy(hdr + 1, log_bin::magic, sizeof log_bin::magic);
+	hdr[5] = (char)log_bin::version;
+	put(hdr, 6);
+
+	const size_t mod_len = std::strlen(rec_mod);
+	uint64_t end = rec_pos.load(std::memory_order_acquire);
+	uint64_t pos = (end > rec_mask + 1) ? end - (rec_mask + 1) : 0;
+
+	for(; pos < end; ++pos){
+		const rec_slot &slot = slots[pos & rec_mask];
+		rec_slot copy;
+
+		if(slot.seq.load(std::memory_order_acquire) != 2 * pos + 2) continue;
+		copy.spec = slot.spec;
+		copy.fmt = slot.fmt;
+		copy.flags = slot.flags;
+		copy.stamp = slot.stamp;
+		copy.fmt_end = slot.fmt_end;
+		copy.len = std::min<uint16_t>(slot.len, sizeof slot.data);
+		std::memcpy(copy.data, slot.data, copy.len);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(slot.seq.load(std::memory_order_relaxed) != 2 * pos + 2 || copy.fmt_end > copy.len) continue;
+
+		// Сообщение бинарного режима со строками формата и имени модуля в самой записи
+		char head[256];
+		log_bin::writer w(head, sizeof head);
+		w.u8(log_bin::rec_message);
+		w.u8(copy.flags);
+		w.u8(copy.stamp);
+		w.varint(0);
+		// Строка формата со статическим временем жизни выводится по указателю
+		if(copy.fmt) w.varint(std::min(std::strlen(copy.fmt), sizeof buf / 2));
+		put(head, w.size());
+		if(copy.fmt) put(copy.fmt, std::min(std::strlen(copy.fmt), sizeof buf / 2));
+		else put(copy.data, copy.fmt_end);
+
+		log_bin::writer t(head, sizeof head);
+		t.varint(0);
+		t.str(rec_mod, mod_len);
+		if(copy.stamp == custom){
+			t.varint(0);
+			t.str(stamp_fmt, std::min<size_t>(std::strlen(stamp_fmt), LOG_STAMP_MAX_LEN));
+		}
+		t.varint((uint64_t)copy.spec.tv_sec);
+		t.varint((uint64_t)copy.spec.tv_nsec);
+		put(head, t.size());
+		put(copy.data + copy.fmt_end, copy.len - copy.fmt_end);
+	}
+
+	write_all(fd, buf, used);
+	::close(fd);
+	return true;
+}
+
+// Обработчик сигналов: вывод самописцев всех логеров. После SIGSEGV и SIGABRT
+// восстанавливается обработчик по умолчанию и сигнал повторяется
+void Logging::crash_handler(int sig)
+{
+	int saved = errno;
+	for(auto &r: recorders){
+		const Logging *l = r.load(std::memory_order_acquire);
+		if(l) l->dump_recorder();
+	}
+	errno = saved;
+
+	if(sig != SIGUSR1) ::raise(sig);
+}
+
+void Logging::install_crash_handler()
+{
+	// Отдельный стек обработчика позволяет вывести самописец при переполнении стека потока
+	static char alt_stack[64 * 1024];
+	stack_t ss{};
+	ss.ss_sp = alt_stack;
+	ss.ss_size = sizeof alt_stack;
+	::sigaltstack(&ss, nullptr);
+
+	struct sigaction sa{};
+	sa.sa_handler = crash_handler;
+	sigemptyset(&sa.sa_mask);
+
+	sa.sa_flags = SA_ONSTACK | SA_RESETHAND;
+	::sigaction(SIGSEGV, &sa, nullptr);
+	::sigaction(SIGABRT, &sa, nullptr);
+
+	sa.sa_flags = SA_ONSTACK | SA_RESTART;
+	::sigaction(SIGUSR1, &sa, nullptr);
+}
+
+void log_fd_sink::write(log_lvl_t, const char *rec, size_t len)
+{
+	write_all(fd, rec, len);
+}
+
+log_file_sink::log_file_sink(const std::string &fname, log_lvl_t lvl): log_sink(lvl)
+{
+	fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+log_file_sink::~log_file_sink()
+{
+	if(fd >= 0) ::close(fd);
+}
+
+void log_file_sink::write(log_lvl_t, const char *rec, size_t len)
+{
+	if(fd >= 0) write_all(fd, rec, len);
+}
+
+void log_file_sink::flush()
+{
+	if(fd >= 0) ::fdatasync(fd);
+}
+
+// Запись в кольцевом буфере: длина (uint32_t) + данные, при переходе через конец буфера
+// запись продолжается с его начала
+log_ring_sink::log_ring_sink(size_t size, log_lvl_t lvl): log_sink(lvl), data(new char[size]), size(size) {}
+
+void log_ring_sink::write_at(size_t pos, const char *src, size_t n)
+{
+	pos %= size;
+	size_t first = std::min(n, size - pos);
+	std::memcpy(&data[pos], src, first);
+	std::memcpy(&data[0], src + first, n - first);
+}
+
+void log_ring_sink::read_at(size_t pos, char *dst, size_t n) const
+{
+	pos %= size;
+	size_t first = std::min(n, size - pos);
+	std::memcpy(dst, &data[pos], first);
+	std::memcpy(dst + first, &data[0], n - first);
+}
+
+void log_ring_sink::write(log_lvl_t, const char *rec, size_t len)
+{
+	const size_t need = sizeof(uint32_t) + len;
+	if(need > size) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Вытеснение самых старых записей
+	while(used + need > size){
+		uint32_t n;
+		read_at(head, reinterpret_cast<char*>(&n), sizeof n);
+		head = (head + sizeof n + n) % size;
+		used -= sizeof n + n;
+	}
+
+	uint32_t n = (uint32_t)len;
+	write_at(head + used, reinterpret_cast<const char*>(&n), sizeof n);
+	write_at(head + used + sizeof n, rec, len);
+	used += need;
+}
+
+std::string log_ring_sink::contents() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::string out;
+	out.reserve(used);
+	for(size_t off = 0; off < used; ){
+		uint32_t n;
+		read_at(head + off, reinterpret_cast<char*>(&n), sizeof n);
+		size_t at = out.size();
+		out.resize(at + n);
+		read_at(head + off + sizeof n, &out[at], n);
+		off += sizeof n + n;
+	}
+	return out;
+}
+
+void log_ring_sink::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	head = used = 0;
+}
+
+uint64_t Logging::next_stats_id()
+{
+	static std::atomic<uint64_t> id{0};
+	return ++id;
+}
+
+// Интервал гистограммы k содержит длительности [2^k, 2^(k+1)) нс, интервал 0 - также нулевые
+void Logging::stats_block::hist(counter (&h)[stats_t::hist_size], uint64_t ns)
+{
+	size_t k = ns ? 63 - __builtin_clzll(ns) : 0;
+	add(h[std::min(k, stats_t::hist_size - 1)]);
+}
+
+// Счетчики текущего потока. Последние использованные потоком блоки кэшируются,
+// при промахе блок ищется (создается) под блокировкой списка
+Logging::stats_block& Logging::local_stats() const
+{
+	struct cache_t{
+		uint64_t id;
+		stats_block *blk;
+	};
+	static thread_local cache_t cache[4] = {};
+	static thread_local unsigned victim = 0;
+
+	for(auto &c: cache){
+		if(c.id == stats_id) return *c.blk;
+	}
+
+	auto self = std::this_thread::get_id();
+	stats_block *blk = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		for(auto &b: stats_blocks){
+			if(b->owner == self){
+				blk = b.get();
+				break;
+			}
+		}
+		if(!blk){
+			stats_blocks.emplace_back(new stats_block);
+			blk = stats_blocks.back().get();
+			blk->owner = self;
+		}
+	}
+
+	cache[victim++ % 4] = {stats_id, blk};
+	return *blk;
+}
+
+void Logging::count_emitted(log_lvl_t flags) const
+{
+	size_t lvl = std::min<size_t>(flags & LOG_LVL_BIT_MASK, stats_t::lvl_num - 1);
+	stats_block::add(local_stats().emitted[lvl]);
+}
+
+void Logging::count_dropped(stats_t::drop_t reason) const
+{
+	stats_block::add(local_stats().dropped[reason]);
+	drops_pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Logging::stats_t::total_emitted() const
+{
+	uint64_t n = 0;
+	for(auto v: emitted) n += v;
+	return n;
+}
+
+uint64_t Logging::stats_t::total_dropped() const
+{
+	uint64_t n = 0;
+	for(auto v: dropped) n += v;
+	return n;
+}
+
+uint64_t Logging::stats_t::percentile(const uint64_t (&hist)[hist_size], double q)
+{
+	uint64_t total = 0;
+	for(auto v: hist) total += v;
+	if(!total) return 0;
+
+	uint64_t need = (uint64_t)(q * total), n = 0;
+	for(size_t k = 0; k < hist_size; ++k){
+		n += hist[k];
+		if(n > need || n == total) return k ? (2ull << k) - 1 : 0;
+	}
+	return 0;
+}
+
+// Получение статистики: сумма счетчиков всех потоков
+Logging::stats_t Logging::stats() const
+{
+	stats_t s;
+	auto sum = [](uint64_t &to, const stats_block::counter &from){ to += from.load(std::memory_order_relaxed); };
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	for(auto &b: stats_blocks){
+		for(size_t i = 0; i < stats_t::lvl_num; ++i) sum(s.emitted[i], b->emitted[i]);
+		for(size_t i = 0; i < stats_t::drop_num; ++i) sum(s.dropped[i], b->dropped[i]);
+		sum(s.bytes_stdout, b->bytes_stdout);
+		sum(s.bytes_file, b->bytes_file);
+		sum(s.rotations, b->rotations);
+		sum(s.records_file, b->records_file);
+		sum(s.writes_file, b->writes_file);
+		sum(s.syncs_file, b->syncs_file);
+		for(size_t i = 0; i < overload_num; ++i) sum(s.overload[i], b->overload[i]);
+		for(size_t i = 0; i < stats_t::hist_size; ++i){
+			sum(s.lock_wait[i], b->lock_wait[i]);
+			sum(s.write_time[i], b->write_time[i]);
+		}
+	}
+	return s;
+}
+
+// Включение (выключение) периодического вывода статистики
+void Logging::set_stats_dump(std::chrono::milliseconds period, log_lvl_t flags)
+{
+	if(stats_thread.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(stats_dump_mutex);
+			stats_dump_stop = true;
+		}
+		stats_dump_cv.notify_one();
+		stats_thread.join();
+	}
+
+	if(period.count() <= 0) return;
+
+	stats_dump_stop = false;
+	stats_thread = std::thread([this, period, flags]{
+		std::unique_lock<std::mutex> lock(stats_dump_mutex);
+		while(!stats_dump_cv.wait_for(lock, period, [this]{ return stats_dump_stop; })){
+			lock.unlock();
+			msg(flags, LOG_FMT("Logger stats: %s\n"), stats());
+			lock.lock();
+		}
+	});
+}
+
+void log_formatter<Logging::stats_t>::format(log_buf &out, const Logging::stats_t &s)
+{
+	static const char lvl_names[] = "-EWIDVT";
+	static const char *drop_names[] = {"lock", "open", "write", "long", "space", "queue", "overflow"};
+	static const char *overload_names[] = {"block", "newest", "oldest", "spill"};
+	static_assert(sizeof(drop_names) / sizeof(drop_names[0]) == Logging::stats_t::drop_num, "drop reasons");
+
+	char tmp[64];
+	auto put = [&out, &tmp](int n){ if(n > 0) out.append(tmp, std::min<size_t>(n, sizeof(tmp) - 1)); };
+
+	put(std::snprintf(tmp, sizeof tmp, "emitted %llu [", (unsigned long long)s.total_emitted()));
+	for(size_t i = 1; i < Logging::stats_t::lvl_num; ++i)
+		put(std::snprintf(tmp, sizeof tmp, "%s%c %llu", i > 1 ? " " : "", lvl_names[i], (unsigned long long)s.emitted[i]));
+	put(std::snprintf(tmp, sizeof tmp, "], dropped %llu [", (unsigned long long)s.total_dropped()));
+	for(size_t i = 0; i < Logging::stats_t::drop_num; ++i)
+		put(std::snprintf(tmp, sizeof tmp, "%s%s %llu", i ? " " : "", drop_names[i], (unsigned long long)s.dropped[i]));
+	put(std::snprintf(tmp, sizeof tmp, "], overload ["));
+	for(size_t i = 0; i < Logging::overload_num; ++i)
+		put(std::snprintf(tmp, sizeof tmp, "%s%s %llu", i ? " " : "", overload_names[i], (unsigned long long)s.overload[i]));
+	put(std::snprintf(tmp, sizeof tmp, "], stdout %llu B, file %llu B, rotations %llu",
+		(unsigned long long)s.bytes_stdout, (unsigned long long)s.bytes_file, (unsigned long long)s.rotations));
+	put(std::snprintf(tmp, sizeof tmp, ", file records/writes/syncs %llu/%llu/%llu",
+		(unsigned long long)s.records_file, (unsigned long long)s.writes_file, (unsigned long long)s.syncs_file));
+	put(std::snprintf(tmp, sizeof tmp, ", lock p50/p99 %llu/%llu ns",
+		(unsigned long long)Logging::stats_t::percentile(s.lock_wait, 0.5), (unsigned long long)Logging::stats_t::percentile(s.lock_wait, 0.99)));
+	put(std::snprintf(tmp, sizeof tmp, ", write p50/p99 %llu/%llu ns",
+		(unsigned long long)Logging::stats_t::percentile(s.write_time, 0.5), (unsigned long long)Logging::stats_t::percentile(s.write_time, 0.99)));
+}
+
+void log_formatter<log_bin::blob>::format(log_buf &out, const log_bin::blob &b)
+{
+	render_hexdump(out, b.data, b.len, b.delim ? b.delim : 16);
+}
+
+// Дамп блока памяти в 16-ричном формате
+void Logging::hex_dump(log_lvl_t flags, const char *buf, size_t len, const std::string &msg_str, uint8_t delim)
+{
+	dump_hex(nullptr, flags, reinterpret_cast<const uint8_t*>(buf), len, msg_str, delim);
+}
+
+void Logging::hex_dump(log_lvl_t flags, const uint8_t *buf, size_t len, const std::string &msg_str, uint8_t delim)
+{
+	dump_hex(nullptr, flags, buf, len, msg_str, delim);
+}
+
+void Logging::hex_dump(const log_module &mod, log_lvl_t flags, const char *buf, size_t len, const std::string &msg_str, uint8_t delim)
+{
+	dump_hex(&mod, flags, reinterpret_cast<const uint8_t*>(buf), len, msg_str, delim);
+}
+
+void Logging::hex_dump(const log_module &mod, log_lvl_t flags, const uint8_t *buf, size_t len, const std::string &msg_str, uint8_t delim)
+{
+	dump_hex(&mod, flags, buf, len, msg_str, delim);
+}
+
+void Logging::dump_hex(const log_module *mod, log_lvl_t flags, const uint8_t *buf, size_t len, const std::string &msg_str, uint8_t delim,
+	log_site_ctl::mode_t site_mode) const
+{
+	log_lvl_t curr_lvl = lvl_of(mod);
+	if(site_mode == log_site_ctl::mode_on) curr_lvl = std::max<log_lvl_t>(curr_lvl, flags & LOG_LVL_BIT_MASK);
+	if( !log_lvl_compiled(flags) || !passes(flags, curr_lvl) ){
+		return;
+	} 
+
+	if(!delim) delim = 16;
+
+	// Весь дамп формируется в одном буфере и выводится одной записью
+	auto body = [&](log_buf &out){
+		out.append(msg_str);
+		out.push_back('\n');
+		render_hexdump(out, buf, len, delim);
+	};
+
+	// В бинарный лог-файл блок записывается без преобразования, дамп формирует logger-decode
+	if(binary){
+		this->to_binary(mod, flags, stamp_type, "%s\n%s", msg_str, log_bin::blob{buf, len, delim});
+		return;
+	}
+
+	this->emit(mod, flags, curr_lvl, stamp_type, body);
+}
+
+std::string Logging::padding(int col_size, const std::string &s, const char pad)
+{
+	// Проверяем используют ASCII (однобайтовые) символы или же двухбайтовые 
+	int two_bytes_char = 0;
+	for(const unsigned char &c : s){
+		if((c == 0xD0) || (c == 0xD1)){
+			++two_bytes_char;
+		}
+	}
+
+	int pad_num = col_size - s.size() + two_bytes_char;
+	if(pad_num < 0){
+		return s;
+	} 
+
+	std::string::size_type indent_left = pad_num / 2;
+	std::string::size_type indent_right(indent_left);
+	if(pad_num % 2){
+		++indent_right;
+	} 
+
+	return (std::string(indent_left, pad) + s + std::string(indent_right, pad));
+}
+
+// Реестр строк бинарного режима
+// Реестр модулей логирования. Не уничтожается при завершении процесса: модули доступны
+// логированию из деструкторов статических объектов
+struct log_module_registry{
+	std::mutex mutex;
+	std::vector<std::unique_ptr<log_module>> modules;
+
+	static log_module_registry& instance(){
+		static log_module_registry *reg = new log_module_registry;
+		return *reg;
+	}
+
+	log_module* find(const std::string &name){
+		for(auto &m: modules) if(m->name() == name) return m.get();
+		return nullptr;
+	}
+};
+
+log_module& log_module::get(const std::string &name)
+{
+	auto &reg = log_module_registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	if(log_module *m = reg.find(name)) return *m;
+
+	reg.modules.emplace_back(new log_module(name));
+	return *reg.modules.back();
+}
+
+log_module* log_module::find(const std::string &name)
+{
+	auto &reg = log_module_registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	return reg.find(name);
+}
+
+void log_module::for_each(const std::function<void(log_module&)> &fn)
+{
+	auto &reg = log_module_registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	for(auto &m: reg.modules) fn(*m);
+}
+
+// Реестр мест вызова и правил управления выводом (не удаляется до завершения процесса)
+struct log_site_registry{
+	struct rule{
+		std::string pattern;
+		log_site_ctl::mode_t mode;
+	};
+
+	std::mutex mutex;
+	std::vector<std::pair<const log_site*, log_site_ctl*>> sites;
+	std::vector<rule> rules;
+
+	static log_site_registry& instance(){
+		static log_site_registry *reg = new log_site_registry;
+		return *reg;
+	}
+
+	// Шаблон "файл:строка" или шаблон имени файла или функции
+	static bool matches(const log_site &site, const std::string &pattern){
+		size_t colon = pattern.rfind(':');
+		if(colon != std::string::npos && colon > 0 && colon + 1 < pattern.size() && pattern[colon - 1] != ':' &&
+		   pattern.find_first_not_of("0123456789", colon + 1) == std::string::npos){
+			std::string file = pattern.substr(0, colon);
+			return site.line == std::strtoul(pattern.c_str() + colon + 1, nullptr, 10) && !fnmatch(file.c_str(), site.file, 0);
+		}
+
+		return !fnmatch(pattern.c_str(), site.file, 0) || !fnmatch(pattern.c_str(), site.func, 0);
+	}
+
+	// Режим по последнему подходящему правилу
+	log_site_ctl::mode_t mode_of(const log_site &site) const{
+		for(auto r = rules.rbegin(); r != rules.rend(); ++r) if(matches(site, r->pattern)) return r->mode;
+		return log_site_ctl::mode_default;
+	}
+};
+
+log_site_ctl::mode_t log_site_ctl::attach(const log_site &site)
+{
+	auto &reg = log_site_registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	// Место вызова могло быть зарегистрировано другим потоком
+	uint8_t m = state.load(std::memory_order_relaxed);
+	if(m != mode_unknown) return (mode_t)m;
+
+	reg.sites.emplace_back(&site, this);
+	mode_t mode = reg.mode_of(site);
+	state.store(mode, std::memory_order_relaxed);
+	return mode;
+}
+
+size_t log_site_ctl::set(const std::string &pattern, mode_t mode)
+{
+	if(mode == mode_unknown) return 0;
+
+	auto &reg = log_site_registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	// Повторное правило для того же шаблона заменяет прежнее
+	auto &rules = reg.rules;
+	rules.erase(std::remove_if(rules.begin(), rules.end(), [&](const log_site_registry::rule &r){ return r.pattern == pattern; }), rules.end());
+	rules.push_back({pattern, mode});
+
+	size_t n = 0;
+	for(auto &s: reg.sites){
+		if(!log_site_registry::matches(*s.first, pattern)) continue;
+		s.second->state.store(mode, std::memory_order_relaxed);
+		++n;
+	}
+
+	return n;
+}
+
+bool log_site_ctl::apply(const std::string &cmd)
+{
+	size_t beg = cmd.find_first_not_of(" \t\r\n");
+	if(beg == std::string::npos || cmd[beg] == '#') return true;
+	size_t end = cmd.find_last_not_of(" \t\r\n") + 1;
+
+	mode_t mode;
+	switch(cmd[beg]){
+		case '+': mode = mode_on; break;
+		case '-': mode = mode_off; break;
+		case '=': mode = mode_default; break;
+		default: return false;
+	}
+
+	std::string pattern = cmd.substr(beg + 1, end - beg - 1);
+	if(pattern.empty()) return false;
+
+	set(pattern, mode);
+	return true;
+}
+
+bool log_site_ctl::load(const std::string &fname)
+{
+	std::ifstream in(fname);
+	if(!in) return false;
+
+	bool ok = true;
+	for(std::string line; std::getline(in, line); ) ok = apply(line) && ok;
+	return ok;
+}
+
+void log_site_ctl::reset()
+{
+	auto &reg = log_site_registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	reg.rules.clear();
+	for(auto &s: reg.sites) s.second->state.store(mode_default, std::memory_order_relaxed);
+}
+
+void log_site_ctl::for_each(const std::function<void(const log_site&, mode_t)> &fn)
+{
+	auto &reg = log_site_registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	for(auto &s: reg.sites) fn(*s.first, (mode_t)s.second->state.load(std::memory_order_relaxed));
+}
+
+log_bin::registry& log_bin::registry::instance()
+{
+	static registry reg;
+	return reg;
+}
+
+uint32_t log_bin::registry::intern(uint64_t key, uint8_t kind, const char *text, size_t len, bool copy, bool &added)
+{
+	added = false;
+	if(!key) key = 1;
+
+	// Открытая адресация с линейным пробированием, идентификатор = индекс + 1
+	size_t idx = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 52) % size;
+
+	for(size_t n = 0; n < size; ++n, idx = (idx + 1) % size){
+		entry &e = entries[idx];
+		uint64_t k = e.key.load(std::memory_order_acquire);
+
+		if(k == key){
+			// Строка добавляется другим потоком: ожидание ее публикации
+			if(!e.text.load(std::memory_order_acquire)) std::lock_guard<std::mutex> lock(add_mutex);
+			return (uint32_t)idx + 1;
+		}
+		if(k != 0) continue;
+
+		// Ячейка занимается под блокировкой реестра, пока строка не получит порядковый номер
+		std::lock_guard<std::mutex> lock(add_mutex);
+		if(!e.key.compare_exchange_strong(k, key, std::memory_order_acq_rel)){
+			if(k == key) return (uint32_t)idx + 1;
+			continue;
+		}
+
+		const char *t = text;
+		if(copy){
+			char *c = new char[len + 1];
+			std::memcpy(c, text, len);
+			c[len] = '\0';
+			t = c;
+		}
+		e.kind = kind;
+		e.text.store(t, std::memory_order_release);
+
+		uint32_t num = added_num.load(std::memory_order_relaxed);
+		order[num] = (uint32_t)idx + 1;
+		added_num.store(num + 1, std::memory_order_release);
+
+		added = true;
+		return (uint32_t)idx + 1;
+	}
+
+	return 0;
+}
+
+uint32_t log_bin::registry::intern_fmt(const char *fmt, bool &added)
+{
+	return intern((uint64_t)(uintptr_t)fmt, kind_fmt, fmt, 0, false, added);
+}
+
+uint32_t log_bin::registry::intern_module(const std::string &name, bool &added)
+{
+	// FNV-1a по содержимому имени
+	uint64_t h = 14695981039346656037ULL;
+	for(unsigned char c : name){
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+
+	return intern(h, kind_module, name.c_str(), name.size(), true, added);
+}
+
+void log_bin::registry::define(writer &w, uint32_t id) const
+{
+	const entry &e = entries[id - 1];
+	const char *t = e.text.load(std::memory_order_acquire);
+	if(!t) return;
+
+	w.u8(rec_define);
+	w.varint(id);
+	w.u8(e.kind);
+	w.str(t, std::strlen(t));
+}
+
+void log_bin::registry::dump(log_buf &out, uint32_t from, uint32_t to) const
 {
-	if(type == no_stamp) return "";
+	char buf[1024];
 
-	struct tm timeinfo;
-	struct timespec spec;
- 
-	clock_gettime(CLOCK_REALTIME, &spec);
+	for(uint32_t i = from; i < to; ++i){
+		writer w(buf, sizeof buf);
+		define(w, order[i]);
+		if(w.ok()) out.append(buf, w.size());
+	}
+}
+
+uint32_t log_bin::registry::dump(log_buf &out) const
+{
+	uint32_t num = count();
+	dump(out, 0, num);
+	return num;
+}
+
+log_uring::log_uring(bool s): sync(s)
+{
+	for(block_t &b : blocks) b.data.reset(new char[block_size]);
+	if(!setup()) teardown();
+}
+
+log_uring::~log_uring()
+{
+	drain();
+	teardown();
+}
+
+// Создание io_uring и отображение его колец. false - io_uring недоступен
+bool log_uring::setup()
+{
+#ifdef LOG_HAVE_URING
+	struct io_uring_params p;
+	std::memset(&p, 0, sizeof p);
+
+	// На каждый блок - запись и fdatasync
+	ring_fd = (int)::syscall(__NR_io_uring_setup, blocks_num * 2, &p);
+	if(ring_fd < 0) return false;
 
-	if(!localtime_r(&spec.tv_sec, &timeinfo)){
-		return "localtime_r failed";
+	ring.sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring.cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+	if(single) ring.sq_len = ring.cq_len = std::max(ring.sq_len, ring.cq_len);
+
+	void *sq = ::mmap(nullptr, ring.sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if(sq == MAP_FAILED) return false;
+	ring.sq_ptr = sq;
+
+	void *cq = sq;
+	if(!single){
+		cq = ::mmap(nullptr, ring.cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if(cq == MAP_FAILED) return false;
 	}
+	ring.cq_ptr = cq;
 
-	char time_str[64] = {0};
+	ring.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	void *sqes = ::mmap(nullptr, ring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if(sqes == MAP_FAILED) return false;
+	ring.sqes = sqes;
 
-	switch(type){
-        case only_time: strftime(time_str, sizeof time_str, "[ %T ]", &timeinfo); break;
-        case ms_time: {
-            strftime(time_str, sizeof time_str, "%d.%m.%y %T", &timeinfo); 
-            char buf[80] = {0};
-            snprintf(buf, sizeof buf, "[ %s.%03lu ]%s ", time_str, spec.tv_nsec / 1000000L, module_name.c_str());
-            std::string s {buf};
-            return s;
-        }
-
-        case custom: strftime(time_str, sizeof time_str, fmt, &timeinfo); break;
-
-        case date_time: 
-        default:
-            strftime(time_str, sizeof time_str, "[ %d.%m.%y %T ]", &timeinfo); break;
-    }
+	char *sp = static_cast<char*>(sq);
+	ring.sq_head = reinterpret_cast<unsigned*>(sp + p.sq_off.head);
+	ring.sq_tail = reinterpret_cast<unsigned*>(sp + p.sq_off.tail);
+	ring.sq_mask = reinterpret_cast<unsigned*>(sp + p.sq_off.ring_mask);
+	ring.sq_array = reinterpret_cast<unsigned*>(sp + p.sq_off.array);
 
-	std::string s {time_str};
-	s += module_name + " "; 
+	char *cp = static_cast<char*>(cq);
+	ring.cq_head = reinterpret_cast<unsigned*>(cp + p.cq_off.head);
+	ring.cq_tail = reinterpret_cast<unsigned*>(cp + p.cq_off.tail);
+	ring.cq_mask = reinterpret_cast<unsigned*>(cp + p.cq_off.ring_mask);
+	ring.cqes = cp + p.cq_off.cqes;
+	return true;
+#else
+	return false;
+#endif
+}
 
-	return s;
+void log_uring::teardown()
+{
+	if(ring.sqes) ::munmap(ring.sqes, ring.sqes_len);
+	if(ring.cq_ptr && ring.cq_ptr != ring.sq_ptr) ::munmap(ring.cq_ptr, ring.cq_len);
+	if(ring.sq_ptr) ::munmap(ring.sq_ptr, ring.sq_len);
+	ring = ring_t();
+
+	if(ring_fd >= 0) ::close(ring_fd);
+	ring_fd = -1;
 }
 
-// Получение текущего размера лог-файла
-uint64_t Logging::get_file_size (const std::string& fname)
+void log_uring::attach(int new_fd, uint64_t offset)
 {
-    struct stat st;
-    if (0 != stat(fname.c_str(), &st)) return 0;
+	submit();
+	fd = new_fd;
+	off = offset;
+}
 
-    return (uint64_t)st.st_size;
+size_t log_uring::write(const char *buf, size_t len)
+{
+	if(fd < 0) return 0;
+
+	size_t done = 0;
+	while(done < len){
+		if(!cur){
+			cur = take_block();
+			cur->fd = fd;
+			cur->off = off;
+		}
+
+		size_t n = std::min(len - done, block_size - cur->len);
+		std::memcpy(cur->data.get() + cur->len, buf + done, n);
+		cur->len += n;
+		off += n;
+		done += n;
+
+		if(cur->len == block_size) submit_block();
+	}
+
+	// Пока у ядра есть незавершенные операции, данные накапливаются в блоке
+	if(inflight) reap(false);
+	if(!inflight && cur) submit_block();
+
+	return done;
 }
 
-// Дамп блока памяти в 16-ричном формате
-void Logging::hex_dump(log_lvl_t flags, const char *buf, size_t len, const std::string &msg_str, uint8_t delim)
+void log_uring::submit()
 {
-	hex_dump(flags, reinterpret_cast<const uint8_t*>(buf), len, msg_str, delim);
+	if(cur) submit_block();
 }
 
-void Logging::hex_dump(log_lvl_t flags, const uint8_t *buf, size_t len, const std::string &msg_str, uint8_t delim)
+void log_uring::drain()
+{
+	submit();
+	while(inflight) reap(true);
+}
+
+log_uring::block_t* log_uring::take_block()
+{
+	for(;;){
+		for(block_t &b : blocks){
+			if(!b.busy) return &b;
+		}
+		// Все блоки отправлены - ожидание завершения записи
+		reap(true);
+	}
+}
+
+void log_uring::submit_block()
 {
-	if( !check_lvl(flags) ){
+	block_t &b = *cur;
+	cur = nullptr;
+
+	if(!is_native()){
+		write_sync(b, 0);
+		b.len = 0;
 		return;
-	} 
+	}
 
-	// Синхронизация вывода
-	std::unique_lock<std::recursive_mutex> lock(Logging::log_print_mutex);
+#ifdef LOG_HAVE_URING
+	auto push = [this]() -> struct io_uring_sqe* {
+		unsigned tail = *ring.sq_tail;
+		unsigned idx = tail & *ring.sq_mask;
+		struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(ring.sqes) + idx;
+		std::memset(sqe, 0, sizeof *sqe);
+		ring.sq_array[idx] = idx;
+		__atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+		++queued;
+		return sqe;
+	};
 
-	Logging::stamp_t tmp = this->get_time_stamp();
-	msg(flags, "%s",  msg_str);	
-	this->set_time_stamp(Logging::no_stamp);
-	for(size_t i = 0; i < len; ++i){
-		if(i % delim == 0) msg(flags, "\n\t");
-		msg(flags, "%02X%s", buf[i], (((i + 1) % 8) == 0) ? "  " : " ");
+	struct io_uring_sqe *sqe = push();
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = b.fd;
+	sqe->addr = (uint64_t)(uintptr_t)b.data.get();
+	sqe->len = (uint32_t)b.len;
+	sqe->off = b.off;
+	sqe->user_data = (uint64_t)(&b - blocks);
+	// fdatasync выполняется только после успешной записи блока
+	if(sync) sqe->flags = IOSQE_IO_LINK;
+
+	if(sync){
+		// user_data == blocks_num - результат fdatasync (не обрабатывается)
+		struct io_uring_sqe *fsq = push();
+		fsq->opcode = IORING_OP_FSYNC;
+		fsq->fd = b.fd;
+		fsq->fsync_flags = IORING_FSYNC_DATASYNC;
+		fsq->user_data = blocks_num;
 	}
-	msg(flags, "\n");
-	this->set_time_stamp(tmp);
+#endif
+
+	b.busy = true;
+	++inflight;
+	enter(0);
 }
 
-std::string Logging::padding(int col_size, const std::string &s, const char pad)
+void log_uring::write_sync(block_t &b, size_t done)
 {
-	// Проверяем используют ASCII (однобайтовые) символы или же двухбайтовые 
-	int two_bytes_char = 0;
-	for(const unsigned char &c : s){
-		if((c == 0xD0) || (c == 0xD1)){
-			++two_bytes_char;
+	while(done < b.len){
+		ssize_t n = ::pwrite(b.fd, b.data.get() + done, b.len - done, (off_t)(b.off + done));
+		++calls;
+		if(n < 0){
+			if(errno == EINTR) continue;
+			break;
 		}
+		done += n;
 	}
 
-	int pad_num = col_size - s.size() + two_bytes_char;
-	if(pad_num < 0){
-		return s;
-	} 
+	if(sync){
+		::fdatasync(b.fd);
+		++calls;
+	}
+}
 
-	std::string::size_type indent_left = pad_num / 2;
-	std::string::size_type indent_right(indent_left);
-	if(pad_num % 2){
-		++indent_right;
-	} 
+void log_uring::reap(bool wait)
+{
+#ifdef LOG_HAVE_URING
+	if(ring_fd < 0) return;
+	if(wait && inflight) enter(1);
 
-	return (std::string(indent_left, pad) + s + std::string(indent_right, pad));
+	unsigned head = *ring.cq_head;
+	unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+	for(; head != tail; ++head){
+		const struct io_uring_cqe *cqe = static_cast<const struct io_uring_cqe*>(ring.cqes) + (head & *ring.cq_mask);
+		if(cqe->user_data >= blocks_num) continue;
+
+		block_t &b = blocks[cqe->user_data];
+		int res = cqe->res;
+
+		// Ошибка или неполная запись - дозапись синхронно.
+		// EINVAL - ядро не поддерживает IORING_OP_WRITE, далее используется pwrite()
+		if(res < 0 || (size_t)res < b.len){
+			if(res == -EINVAL) broken = true;
+			write_sync(b, res > 0 ? (size_t)res : 0);
+		}
+
+		b.busy = false;
+		b.len = 0;
+		--inflight;
+	}
+
+	__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+#endif
+}
+
+void log_uring::enter(unsigned min_complete)
+{
+#ifdef LOG_HAVE_URING
+	if(!queued && !min_complete) return;
+
+	unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+	for(;;){
+		int ret = (int)::syscall(__NR_io_uring_enter, ring_fd, queued, min_complete, flags, nullptr, 0);
+		++calls;
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret > 0) queued -= std::min((unsigned)ret, queued);
+		break;
+	}
+#endif
+}
+
+// Форматирование по строке формата, разбираемой во время выполнения.
+// Спецификатор без соответствующего аргумента выводится как есть
+void log_fmt::format_runtime(log_buf &out, const char *fmt, const arg_ref *args, size_t nargs)
+{
+	size_t next = 0;
+	const char *text = fmt;
+
+	for(const char *p = fmt; *p; ){
+		if(*p != '%'){ ++p; continue; }
+
+		out.append(text, p - text);
+
+		if(p[1] == '%'){
+			out.push_back('%');
+			p += 2;
+			text = p;
+			continue;
+		}
+
+		spec_t sp{};
+		size_t n = parse_spec(p, 1, sp);
+		if(!n){
+			// Некорректный спецификатор
+			text = p++;
+			continue;
+		}
+
+		size_t need = next + sp.star_width + sp.star_prec;
+		if(need >= nargs){
+			text = p;
+			p += n;
+			continue;
+		}
+
+		if(sp.star_width){
+			sp.width = args[next].to_int(args[next].ptr);
+			if(sp.width < 0){ sp.left = true; sp.width = -sp.width; }
+			++next;
+		}
+		if(sp.star_prec){
+			sp.prec = args[next].to_int(args[next].ptr);
+			if(sp.prec < 0) sp.prec = -1;
+			++next;
+		}
+
+		args[next].put(out, sp, args[next].ptr);
+		++next;
+
+		p += n;
+		text = p;
+	}
+
+	out.append(text, std::strlen(text));
 }
 
 // Для использования одного экземпляра логгера в нескольких файлах проекта
@@ -117,6 +2401,17 @@ Logging logger;
 #ifdef _LOGGER_TEST
 #include <thread>
 
+struct test_point{
+	int x, y;
+};
+
+template<>
+struct log_formatter<test_point>{
+	static void format(log_buf &out, const test_point &p){
+		log_fmt::format(out, LOG_FMT("(%d, %d)"), p.x, p.y);
+	}
+};
+
 void printer(Logging *obj, int num, int thread_no)
 {
 	for(int i = 0; i < num; ++i){
@@ -137,14 +2432,428 @@ void printer_error(Logging *obj, int num, int thread_no)
     return;
 }
 
+// Место вызова метода класса (имя метода выделяется из __PRETTY_FUNCTION__ при компиляции)
+struct site_test{
+	template<typename T>
+	void run(Logging &logger, T v) const{
+		logger.msg(MSG_DEBUG, "%s\n", excp_method("method exception"));
+		logging_err(logger, "site of template method: %d\n", v);
+	}
+};
+
+// Подсчет выделений динамической памяти (operator new также выделяет память через malloc)
+static std::atomic<bool> test_count_allocs{false};
+static std::atomic<size_t> test_allocs{0};
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+	if(test_count_allocs.load(std::memory_order_relaxed)) test_allocs.fetch_add(1, std::memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+	if(test_count_allocs.load(std::memory_order_relaxed)) test_allocs.fetch_add(1, std::memory_order_relaxed);
+	return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if(test_count_allocs.load(std::memory_order_relaxed)) test_allocs.fetch_add(1, std::memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+// Выделение выровненной памяти (в том числе operator new для типов с повышенным выравниванием)
+void *memalign(size_t alignment, size_t size)
+{
+	if(test_count_allocs.load(std::memory_order_relaxed)) test_allocs.fetch_add(1, std::memory_order_relaxed);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+	if(alignment < sizeof(void*) || (alignment & (alignment - 1))) return EINVAL;
+	void *p = memalign(alignment, size);
+	if(!p && size) return ENOMEM;
+	*ptr = p;
+	return 0;
+}
+}
+
+// Формирование и вывод num записей (сообщения, ошибки и события) без выделения динамической памяти
+// (после первых записей потока и первой ротации). Логер уровня lvl выводит записи в лог-файл с ротацией
+// и (выше MSG_SILENT) в stdout, async - асинхронный режим. Возвращает число выделений
+size_t test_no_alloc(log_lvl_t lvl, bool async, int num)
+{
+	Logging alloc_logger(lvl, "[ ALLOC ]", "Log.alloc", 2, MB_to_B(4));
+	if(async) alloc_logger.set_async(true);
+	// Дамп длиннее LOG_RECORD_MAX_LEN (в асинхронном режиме может переходить через конец очереди)
+	static uint8_t frame[2048];
+	auto run = [&alloc_logger](int from, int num){
+		for(int i = from; i < from + num; ++i){
+			if(i % 512 == 0) logging_hexdump(alloc_logger, MSG_DEBUG | MSG_TO_FILE, frame, sizeof frame, "frame");
+			logging_msg(alloc_logger, MSG_DEBUG | MSG_TO_FILE, "record #%d: %s %.3f\n", i, "text", i * 0.5);
+			if(i % 16 == 0) logging_err(alloc_logger, "error record #%d\n", i);
+			if(i % 64 == 0) alloc_logger.event(MSG_INFO | MSG_TO_FILE, "tick").kv("n", i).kv("name", "alloc").kv("rate", i * 0.25);
+		}
+	};
+
+	run(0, 200000);
+	alloc_logger.flush();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	// Учитываются и выделения потока вывода асинхронного режима
+	test_allocs = 0;
+	test_count_allocs = true;
+	run(200000, num);
+	alloc_logger.flush();
+	test_count_allocs = false;
+
+	return test_allocs;
+}
+
+// Содержимое файла (пустая строка - файл не прочитан)
+std::string test_read_file(const char *name)
+{
+	std::string data;
+	std::FILE *fp = std::fopen(name, "rb");
+	if(!fp) return data;
+
+	char buf[4096];
+	size_t n;
+	while((n = std::fread(buf, 1, sizeof buf, fp)) > 0) data.append(buf, n);
+	std::fclose(fp);
+	return data;
+}
+
+// Определение строки формата бинарного режима не теряется вместе с отброшенной записью:
+// после записи, не поместившейся в буфер, следующая запись с тем же форматом восстанавливается
+bool test_bin_drop()
+{
+	{
+		Logging drop_logger(MSG_SILENT, "[ BINDROP ]", "Log.bindrop");
+		drop_logger.set_binary(true);
+		drop_logger.msg(MSG_DEBUG | MSG_TO_FILE, "session opened\n");
+
+		auto put = [&drop_logger](const std::string &v){ drop_logger.msg(MSG_DEBUG | MSG_TO_FILE, "value %s\n", v); };
+		put(std::string(5000, 'x'));
+		put("ok");
+	}
+
+	// Определение формата должно предшествовать сообщению с аргументом "ok"
+	std::string data = test_read_file("Log.bindrop");
+	size_t def = data.find("value %s\n");
+	size_t arg = data.find("\x02ok");
+	return def != std::string::npos && arg != std::string::npos && def < arg;
+}
+
+// Текст, восстановленный logger-decode (из каталога тестовой программы) из бинарного лог-файла,
+// совпадает с текстом тех же записей в текстовом режиме. -1 - утилита не найдена
+int test_bin_roundtrip()
+{
+	char exe[PATH_MAX];
+	ssize_t n = ::readlink("/proc/self/exe", exe, sizeof exe - 1);
+	if(n <= 0) return -1;
+	exe[n] = 0;
+	std::string decoder = exe;
+	decoder = decoder.substr(0, decoder.rfind('/') + 1) + "logger-decode";
+	if(::access(decoder.c_str(), X_OK)) return -1;
+
+	// Кадр 4 КБ: в бинарном режиме дамп хранится блоком байт и формируется декодером
+	uint8_t frame[4096];
+	for(size_t i = 0; i < sizeof frame; ++i) frame[i] = (uint8_t)(i * 7 + (i >> 8));
+
+	::unlink("Log.rt.txt");
+	::unlink("Log.rt.bin");
+	{
+		Logging txt_logger(MSG_SILENT, "[ RT ]", "Log.rt.txt");
+		Logging bin_logger(MSG_SILENT, "[ RT ]", "Log.rt.bin");
+		bin_logger.set_binary(true);
+
+		for(Logging *l : {&txt_logger, &bin_logger}){
+			l->set_time_stamp(Logging::no_stamp);
+			l->msg(MSG_DEBUG | MSG_TO_FILE, "bool %d %s|%6s|\n", true, false, true);
+			l->msg(MSG_DEBUG | MSG_TO_FILE, "long %d, hh %hhd, x %x %lx %o, u %u\n", 5000000000L, 300, -1, -1L, (short)-8, -2);
+			l->msg(MSG_DEBUG | MSG_TO_FILE, "float as int %d, %.3e %g %a %5.1f %Lf\n", 2.5, 12345.678, 0.1f, 1.0, -0.25, (long double)1.5);
+			l->msg(MSG_DEBUG | MSG_TO_FILE, "char %c %d, str %-8s|%5.2s|, ptr %p %p %s\n",
+				'A', (unsigned char)200, "left", std::string("abc"), (void*)0x1234, nullptr, nullptr);
+			l->msg(MSG_DEBUG | MSG_TO_FILE, "star %*d|%-*.*f|%+05d\n", 6, 42, 9, 2, 3.14159, 17);
+			l->msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("compiled %d %s %u %#x\n"), -7, "text", 7u, 255);
+			l->msg(MSG_DEBUG | MSG_TO_FILE, "missing %d %s\n", 1);
+			l->hex_dump(MSG_DEBUG | MSG_TO_FILE, frame, sizeof frame, "frame");
+			l->hex_dump(MSG_DEBUG | MSG_TO_FILE, frame, 13, "short", 8);
+		}
+	}
+
+	std::string text = test_read_file("Log.rt.txt"), decoded;
+	std::FILE *fp = ::popen((decoder + " Log.rt.bin").c_str(), "r");
+	if(!fp) return 0;
+	char buf[4096];
+	size_t len;
+	while((len = std::fread(buf, 1, sizeof buf, fp)) > 0) decoded.append(buf, len);
+	int ret = ::pclose(fp);
+
+	if(ret || text.empty() || decoded != text){
+		std::printf("Binary round trip: text\n%sdecoded\n%s", text.c_str(), decoded.c_str());
+		return 0;
+	}
+	return 1;
+}
+
+// Размер лог-файла и его бэкапов при ротации под нагрузкой нескольких потоков: обычный файл превышает
+// log_max_fsize не более чем на LOG_FILE_OVERSHOOT, отображенный - не превышает.
+// mode: 0 - write(), 1 - io_uring, 2 - пакетная запись, 3 - mmap
+bool test_rotation_size(int mode)
+{
+	static const char *modes[] = {"write", "uring", "batch", "mmap"};
+	const uint64_t limit = KB_to_B(64);
+	const uint32_t files = 3;
+	const int threads = 4, num = 20000;
+	const std::string fname = std::string("Log.rotsize.") + modes[mode];
+
+	uint64_t max_size = 0;
+	bool ok = true;
+	auto check = [&](){
+		for(uint32_t i = 0; i <= files; ++i){
+			std::string name = i ? fname + "." + std::to_string(i) : fname;
+			struct stat st;
+			if(::stat(name.c_str(), &st)){
+				ok = false;
+				continue;
+			}
+			max_size = std::max<uint64_t>(max_size, st.st_size);
+		}
+	};
+
+	Logging::stats_t st;
+	{
+		Logging rot_logger(MSG_SILENT, "[ ROTSIZE ]", fname, files, limit);
+		if(mode == 1) rot_logger.set_uring(true);
+		if(mode == 2) rot_logger.set_batch(KB_to_B(4));
+		if(mode == 3) rot_logger.set_mmap(true);
+
+		std::vector<std::thread> rot_threads;
+		for(int i = 0; i < threads; ++i){
+			rot_threads.emplace_back([&rot_logger, i](){
+				for(int j = 0; j < num; ++j) rot_logger.msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("rotation record #%d.%d: payload\n"), i, j);
+			});
+		}
+		for(auto &th : rot_threads) th.join();
+		rot_logger.flush();
+		st = rot_logger.stats();
+		// Бэкапы проверяются до закрытия: размер отображенного файла на диске до закрытия равен log_max_fsize
+		if(mode != 3) check();
+	}
+	if(mode == 3) check();
+
+	uint64_t cap = limit + ((mode == 3) ? 0 : LOG_FILE_OVERSHOOT);
+	std::printf("Rotation size %s: max %llu of %llu B, rotations %llu, no space %llu\n", modes[mode],
+		(unsigned long long)max_size, (unsigned long long)cap, (unsigned long long)st.rotations,
+		(unsigned long long)st.dropped[Logging::stats_t::drop_no_space]);
+	return ok && st.rotations > files && max_size <= cap;
+}
+
+// Приемник, задерживающий поток вывода асинхронного режима до вызова open()
+struct test_gate_sink: log_sink{
+	std::mutex m;
+	std::condition_variable cv;
+	bool opened = false;
+
+	test_gate_sink(): log_sink(MSG_TRACE) {}
+
+	void write(log_lvl_t, const char*, size_t) override {
+		std::unique_lock<std::mutex> lock(m);
+		cv.wait(lock, [this]{ return opened; });
+	}
+
+	void open(){
+		{
+			std::lock_guard<std::mutex> lock(m);
+			opened = true;
+		}
+		cv.notify_all();
+	}
+};
+
+// Перегрузка асинхронного режима: поток вывода задерживается приемником, записи, не поместившиеся
+// в очередь, откладываются в буфер (policy) объемом 16 КБ и выводятся в файл после освобождения потока.
+// Выведенные записи должны следовать по порядку, их число - совпадать с числом непотерянных записей
+bool test_overload(Logging::overload_t policy, const char *fname)
+{
+	const int num = 2000;
+	Logging::stats_t st;
+	::unlink(fname);
+	{
+		auto gate = std::make_shared<test_gate_sink>();
+		Logging over_logger(MSG_SILENT, "[ OVERLOAD ]", fname, 2, MB_to_B(4));
+		over_logger.set_overload(policy, KB_to_B(16));
+		over_logger.set_async(true, KB_to_B(4));
+		over_logger.add_sink(gate);
+		for(int i = 0; i < num; ++i) over_logger.msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("overload record #%d\n"), i);
+		gate->open();
+		over_logger.flush();
+		st = over_logger.stats();
+	}
+
+	std::string data = test_read_file(fname);
+	int written = 0, first = -1, last = -1;
+	bool ordered = true;
+	for(size_t pos = 0; (pos = data.find("overload record #", pos)) != std::string::npos; ++written){
+		pos += sizeof("overload record #") - 1;
+		int n = std::atoi(data.c_str() + pos);
+		if(first < 0) first = n;
+		if(n <= last) ordered = false;
+		last = n;
+	}
+
+	uint64_t lost = st.dropped[Logging::stats_t::drop_overflow];
+	std::printf("Overload %s: written %d, lost %llu, first #%d, last #%d\n",
+		policy == Logging::overload_spill ? "spill" : "drop_oldest", written, (unsigned long long)lost, first, last);
+
+	// Буфер переполнения растет до предельного объема (в файл выведено больше, чем вмещают очередь
+	// и половина буфера) и отбрасывает новые записи, буфер с вытеснением отбрасывает старые
+	bool ok = ordered && st.overload[policy] && lost && written + lost == (uint64_t)num && first == 0;
+	if(policy == Logging::overload_spill) ok = ok && last < num - 1 && data.size() > KB_to_B(4 + 8);
+	else ok = ok && last == num - 1;
+	return ok;
+}
+
+// Число пропущенных записей получает только запись ограничиваемого места вызова,
+// а не запись, выведенная при вычислении ее аргументов
+bool test_limit_site()
+{
+	Logging limit_logger(MSG_SILENT, "[ LIMIT ]");
+	auto ring = std::make_shared<log_ring_sink>(KB_to_B(4), MSG_TRACE);
+	limit_logger.add_sink(ring);
+
+	auto arg = [&limit_logger](int i){
+		logging_info(limit_logger, "argument record #%d\n", i);
+		return i;
+	};
+	for(int i = 0; i < 4; ++i)
+		log_every_n(2,
+			logging_warn(limit_logger, "limited record #%d\n", arg(i)));
+
+	std::string data = ring->contents();
+	return data.find("argument record #2\n") != std::string::npos
+		&& data.find("limited record #2 [1 suppressed]\n") != std::string::npos;
+}
+
+// Изменение состава приемников во время многопоточного логирования: пишущие потоки работают
+// со снимком списка, подключенный последним приемник получает записи
+bool test_sinks_update()
+{
+	Logging sink_logger(MSG_SILENT, "[ SINKS ]");
+	std::atomic<bool> stop{false};
+	std::vector<std::thread> threads;
+	for(int i = 0; i < 4; ++i){
+		threads.emplace_back([&sink_logger, &stop, i]{
+			for(int j = 0; !stop; ++j) sink_logger.msg(MSG_DEBUG, LOG_FMT("sink record #%d.%d\n"), i, j);
+		});
+	}
+
+	auto ring = std::make_shared<log_ring_sink>(KB_to_B(4), MSG_TRACE);
+	for(int i = 0; i < 1000; ++i){
+		auto sink = std::make_shared<log_ring_sink>(KB_to_B(1), MSG_TRACE);
+		sink_logger.add_sink(sink);
+		sink_logger.remove_sink(sink);
+		if(i % 100 == 0) sink_logger.clear_sinks();
+	}
+	sink_logger.add_sink(ring);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	stop = true;
+	for(auto &th : threads) th.join();
+	if(ring->contents().find("sink record #") == std::string::npos) return false;
+
+	// Изменение уровня подключенного приемника учитывается проверкой уровня логера
+	ring->clear();
+	ring->set_lvl(MSG_ERROR);
+	sink_logger.msg(MSG_DEBUG, LOG_FMT("filtered by sink level\n"));
+	ring->set_lvl(MSG_DEBUG);
+	sink_logger.msg(MSG_DEBUG, LOG_FMT("accepted after sink level change\n"));
+	std::string data = ring->contents();
+	return data.find("filtered") == std::string::npos && data.find("accepted after") != std::string::npos;
+}
+
+// Трассировка выводится только при включении места вызова (log_site_ctl)
+void dyn_debug_site(Logging &logger, int n)
+{
+	logging_trace(logger, "dynamic debug trace #%d\n", n);
+	logging_hexdump(logger, MSG_TRACE, &n, sizeof n, "dynamic debug dump");
+}
+
 int main(int argc, char* argv[])
 {
+	// Вывод в лог-файл, в stdout (перенаправлен в /dev/null), в асинхронном режиме
+	struct{
+		const char *name;
+		log_lvl_t lvl;
+		bool async;
+		int num;
+	} alloc_cases[] = {
+		{"file", MSG_SILENT, false, 1000000},
+		{"stdout", MSG_DEBUG, false, 200000},
+		{"async file", MSG_SILENT, true, 200000},
+		{"async stdout", MSG_DEBUG, true, 200000},
+	};
+	for(auto &c: alloc_cases){
+		std::fflush(stdout);
+		int saved_out = ::dup(STDOUT_FILENO);
+		int null_fd = ::open("/dev/null", O_WRONLY);
+		if(c.lvl != MSG_SILENT) ::dup2(null_fd, STDOUT_FILENO);
+		size_t allocs = test_no_alloc(c.lvl, c.async, c.num);
+		::dup2(saved_out, STDOUT_FILENO);
+		::close(saved_out);
+		::close(null_fd);
+		if(allocs){
+			std::printf("Heap allocations while logging (%s): %zu\n", c.name, allocs);
+			return 1;
+		}
+	}
+
+	if(!test_limit_site()){
+		std::printf("Suppressed count attached to a record of another call site\n");
+		return 1;
+	}
+
+	if(!test_sinks_update()){
+		std::printf("Sink added while logging received no records\n");
+		return 1;
+	}
+
+	if(!test_bin_drop()){
+		std::printf("Binary format definition lost with a dropped record\n");
+		return 1;
+	}
+
 	Logging logger(MSG_VERBOSE, "[ MYLOG ]");
 
 	std::string s{"verbose msg"};
 
 	logger.init(MSG_VERBOSE, "Log.log", 3, KB_to_B(2));
 
+	// Дополнительные приемники: журнал только ошибок и кольцевой буфер последних сообщений всех уровней
+	auto err_sink = std::make_shared<log_file_sink>("Log.err", MSG_ERROR);
+	auto ring_sink = std::make_shared<log_ring_sink>(KB_to_B(1), MSG_TRACE);
+	logger.add_sink(err_sink);
+	logger.add_sink(ring_sink);
+
+	// Бортовой самописец: последние 256 сообщений всех уровней, вывод в Log.log.flight
+	logger.set_recorder(256);
+	Logging::install_crash_handler();
+
 	logger.msg(MSG_VERBOSE, "MESSAGE CONST CHAR TEST\n");
 
 	char buf[4] = {'d', 'b', 'g', 0};
@@ -165,38 +2874,61 @@ int main(int argc, char* argv[])
 
 	logging_perr(logger, "system call failed (%s)", s);
 
+	logging_warn(logger, "warning test: %d\n", 1);
+	logging_info(logger, "info test\n");
+
+	// Строка формата, заданная во время выполнения, разбирается при вызове
+	std::string rt_fmt = "runtime format test: %d\n";
+	const char *rt_str = "runtime string test 100%\n";
+	logging_err(logger, rt_fmt, 3);
+	logging_warn(logger, rt_fmt.c_str(), 4);
+	logging_info(logger, rt_str);
+	logging_msg(logger, MSG_DEBUG, std::string("runtime ") + "temporary format: %s\n", s);
+	logging_perr(logger, std::string("runtime system call failed (%s)"), s);
+
+	// Подсветка префиксов для терминала (в лог-файл записи выводятся без escape-последовательностей)
+	logger.set_console(STDOUT_FILENO, Logging::color_always);
+	logging_err(logger, "colored error test: %d\n", 2);
+	logging_warn(logger, "colored warning test\n");
+	logger.set_console(STDOUT_FILENO);
+	logging_msg_ns(logger, MSG_DEBUG, "message without stamp: %s\n", s);
+
+	try{
+		throw std::runtime_error(excp_func("runtime exception"));
+	}
+	catch(const std::exception &e){
+		logging_excp(logger, "%s\n", e.what());
+	}
+
 	char buff[40];
 	memset(buff, 0xBE, sizeof (buff));
 	logger.hex_dump(MSG_DEBUG, (uint8_t*)buff, sizeof (buff), "buff_hex: ");
+	logger.hex_dump(MSG_DEBUG, "hex dump of text\x01\x02\xFF", 19, "text_hex: ", 8);
 
 	logger.msg(MSG_DEBUG, "%s\n", excp_func(std::string{"error description: "} + strerror(errno)));
+	site_test{}.run(logger, 42);
 
 	bool test_false = false;
 	bool test_true = true;
 	logger.msg(MSG_DEBUG, "Bool values: %s , %s\n", test_false, test_true);
 
-	// int ival;
-	// long lval;
-	// long long llval;
-	// unsigned uival;
-	// unsigned long ulval;
-	// unsigned long long ullval;
-	// float fval;
-	// double dval;
-	// long double ldval;
-	// bool bval;
-
-	// fmt_of(s);   	// basic_string
-	// fmt_of(ival);   	// i
-	// fmt_of(lval);   	// l
-	// fmt_of(llval);  	// x
-	// fmt_of(uival);  	// j
-	// fmt_of(ulval);  	// m
-	// fmt_of(ullval); 	// y
-	// fmt_of(fval);   	// f
-	// fmt_of(dval);   	// d
-	// fmt_of(ldval);  	// e
-	// fmt_of(bval);   	// b
+	// Разбор формата и проверка типов при компиляции
+	int ival = -42;
+	unsigned long ulval = 42;
+	long long llval = -1234567890123LL;
+	double dval = 3.14159;
+	long double ldval = 2.5L;
+	logger.msg(MSG_DEBUG, LOG_FMT("int: %d|%5d|%-5d|%05d, ulong: %lu|%#x|%#o, llong: %lld\n"),
+		ival, ival, ival, ival, ulval, ulval, ulval, llval);
+	logger.msg(MSG_DEBUG, LOG_FMT("double: %f|%.2f|%10.3e|%g, long double: %Lf, str: '%-8s'|'%.3s'\n"),
+		dval, dval, dval, dval, ldval, s, s);
+
+	// Пользовательский тип выводится через log_formatter
+	test_point pt{3, -7};
+	logger.msg(MSG_DEBUG, LOG_FMT("point: %s, bool: %s, ptr: %p\n"), pt, test_true, (void*)nullptr);
+
+	// Формат, разбираемый во время выполнения (в том числе ширина '*')
+	logger.msg(MSG_DEBUG, "runtime: [%*d] [%-*s] [%.*f] %d%%\n", 6, ival, 6, "ab", 1, dval, 100);
 
 	logger.set_time_stamp(Logging::ms_time);
 	
@@ -209,6 +2941,164 @@ int main(int argc, char* argv[])
     std::thread(printer_error, &logger, 10, 10).detach();
     
     std::this_thread::sleep_for(std::chrono::seconds(2));
+
+	// Асинхронный режим: вывод выполняется отдельным потоком
+	logger.set_async(true);
+	logger.msg(MSG_DEBUG | MSG_TO_FILE, "Async mode enabled\n");
+
+	std::vector<std::thread> async_threads;
+	for (int i = 0; i < 4; ++i){
+		async_threads.emplace_back(printer, &logger, 10, i);
+	}
+	for(auto &th : async_threads) th.join();
+
+	logger.flush();
+	logger.set_async(false);
+
+	// Бинарный режим: текст восстанавливается утилитой logger-decode
+	Logging bin_logger(MSG_DEBUG, "[ BINLOG ]", "Log.bin");
+	bin_logger.set_binary(true);
+	bin_logger.msg(MSG_DEBUG | MSG_TO_FILE, "binary record #%d: %s %.2f\n", 1, s, 0.5);
+	logging_err(bin_logger, "binary record #%d\n", 2);
+	bin_logger.event(MSG_INFO | MSG_TO_FILE, "conn_closed").kv("fd", 7).kv("ok", true).kv("peer", "10.0.0.1:80");
+
+	// Запись через отображение файла в память (с ротацией по заполнении файла)
+	Logging map_logger(MSG_SILENT, "[ MAPLOG ]", "Log.map", 2, KB_to_B(4));
+	map_logger.set_mmap(true);
+	for(int i = 0; i < 100; ++i){
+		map_logger.msg(MSG_DEBUG | MSG_TO_FILE, "mapped record #%d: %s\n", i, s);
+	}
+
+	// Запись через io_uring (при недоступности - pwrite)
+	Logging uring_logger(MSG_SILENT, "[ URING ]", "Log.uring", 2, KB_to_B(4));
+	uring_logger.set_uring(true);
+	for(int i = 0; i < 100; ++i){
+		uring_logger.msg(MSG_DEBUG | MSG_TO_FILE, "uring record #%d: %s\n", i, s);
+	}
+	uring_logger.flush();
+
+	// Перегрузка: записи, не поместившиеся в очередь, откладываются в буфер переполнения
+	// (растет до предельного объема) или в буфер с вытеснением старых
+	Logging spill_logger(MSG_SILENT, "[ SPILL ]", "Log.spill");
+	spill_logger.set_overload(Logging::overload_spill, KB_to_B(64));
+	spill_logger.set_async(true, KB_to_B(4));
+	std::vector<std::thread> spill_threads;
+	for (int i = 0; i < 4; ++i){
+		spill_threads.emplace_back([&spill_logger, i]{
+			for(int j = 0; j < 1000; ++j) spill_logger.msg(MSG_DEBUG | MSG_TO_FILE, "spill record #%d.%d\n", i, j);
+		});
+	}
+	for(auto &th : spill_threads) th.join();
+	spill_logger.flush();
+
+	if(!test_overload(Logging::overload_spill, "Log.overspill") || !test_overload(Logging::overload_drop_oldest, "Log.overoldest")){
+		std::printf("Overload backlog test failed\n");
+		return 1;
+	}
+
+	int roundtrip = test_bin_roundtrip();
+	if(roundtrip < 0) std::printf("Binary round trip test skipped: logger-decode not found\n");
+	else if(!roundtrip){
+		std::printf("Binary round trip test failed\n");
+		return 1;
+	}
+
+	for(int mode = 0; mode < 4; ++mode){
+		if(!test_rotation_size(mode)){
+			std::printf("Rotation size test failed\n");
+			return 1;
+		}
+	}
+
+	// Заполненная очередь асинхронного режима по умолчанию ожидает освобождения места: записи не теряются
+	{
+		const int threads = 4, num = 20000;
+		::unlink("Log.asyncburst");
+		Logging::stats_t st;
+		{
+			Logging burst_logger(MSG_SILENT, "[ BURST ]", "Log.asyncburst", 2, MB_to_B(64));
+			burst_logger.set_async(true, KB_to_B(16));
+			std::vector<std::thread> burst_threads;
+			for(int i = 0; i < threads; ++i){
+				burst_threads.emplace_back([&burst_logger, i](){
+					for(int j = 0; j < num; ++j) burst_logger.msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("burst record #%d.%d\n"), i, j);
+				});
+			}
+			for(auto &th : burst_threads) th.join();
+			burst_logger.flush();
+			st = burst_logger.stats();
+		}
+
+		std::string data = test_read_file("Log.asyncburst");
+		int written = 0;
+		for(size_t pos = 0; (pos = data.find("burst record #", pos)) != std::string::npos; ++pos) ++written;
+		std::printf("Async burst: written %d of %d, queue waits %llu\n", written, threads * num, (unsigned long long)st.overload[Logging::overload_block]);
+		if(written != threads * num || st.dropped[Logging::stats_t::drop_queue_full]){
+			std::printf("Async burst test failed\n");
+			return 1;
+		}
+	}
+
+	// Пакетная запись: записи выводятся одним writev() при заполнении буфера и по времени,
+	// записи ошибок - сразу со сбросом на диск
+	{
+		Logging batch_logger(MSG_SILENT, "[ BATCH ]", "Log.batch");
+		batch_logger.set_batch(KB_to_B(4), 50);
+		batch_logger.set_sync(Logging::sync_error | Logging::sync_interval);
+		for(int i = 0; i < 500; ++i) batch_logger.msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("batch record #%d\n"), i);
+		logging_err(batch_logger, "batch error record\n");
+		batch_logger.msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("buffered record\n"));
+
+		// Запись в буфере выводится потоком ротации не позже интервала пакетной записи
+		struct stat st_before, st_after;
+		::stat("Log.batch", &st_before);
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		::stat("Log.batch", &st_after);
+		logger.msg(MSG_DEBUG, LOG_FMT("Batch flushed by timer: %s, stats: %s\n"), st_after.st_size > st_before.st_size, batch_logger.stats());
+	}
+
+	// Ограничение частоты вывода в месте вызова
+	for(int i = 0; i < 1000; ++i){
+		log_every_n(400, logging_err(logger, "packet #%d dropped\n", i));
+		log_first_n(2, logger.msg(MSG_DEBUG, "first packets: #%d\n", i));
+	}
+
+	// Модули со своими уровнями: имя модуля передается с записью, настройки логера не изменяются
+	log_module &net = log_module::get("[ NET ]");
+	net.set_lvl(MSG_TRACE);
+	log_module::get("[ DB ]").set_lvl(MSG_SILENT);
+	logger.msg(net, MSG_TRACE, LOG_FMT("module trace record: level %d\n"), net.get_lvl());
+	logger.msg(log_module::get("[ DB ]"), MSG_ERROR, LOG_FMT("module record: not printed at module level MSG_SILENT, kept by ring sink\n"));
+	logger.event(net, MSG_DEBUG, "module_event").kv("module_lvl", net.get_lvl());
+
+	// Управление выводом мест вызова: трассировка одной функции без изменения уровня логера
+	dyn_debug_site(logger, 0);
+	log_site_ctl::apply("+dyn_debug_site");
+	dyn_debug_site(logger, 1);
+	log_site_ctl::apply("=dyn_*");
+	dyn_debug_site(logger, 2);
+	log_site_ctl::apply("-dyn_debug_site");
+	logger.set_lvl(MSG_TRACE);
+	dyn_debug_site(logger, 3);
+	logger.set_lvl(MSG_VERBOSE);
+	log_site_ctl::reset();
+	size_t sites_num = 0;
+	log_site_ctl::for_each([&](const log_site &, log_site_ctl::mode_t){ ++sites_num; });
+	logger.msg(MSG_DEBUG, LOG_FMT("Registered sites: %zu\n"), sites_num);
+
+	// Структурированные события (строки JSON)
+	logger.event(MSG_INFO | MSG_TO_FILE, "conn_closed").kv("fd", 5).kv("bytes", 1024).kv("rate", 0.75)
+		.kv("peer", std::string("host \"a\"\n")).kv("tls", false);
+	for(int i = 0; i < 5; ++i) log_every_n(2, logger.event(MSG_DEBUG, "tick").kv("n", i));
+
+	logger.msg(MSG_DEBUG, "Ring sink tail:\n%s", ring_sink->contents());
+	logger.clear_sinks();
+	logger.dump_recorder();
+
+	// Статистика работы логера
+	logger.msg(MSG_DEBUG, LOG_FMT("Spill logger stats: %s\n"), spill_logger.stats());
+	logger.msg(MSG_DEBUG, LOG_FMT("Stats: %s\n"), logger.stats());
+	logger.msg(MSG_DEBUG, LOG_FMT("Mapped logger stats: %s\n"), map_logger.stats());
 	return 0;
 }
 #endif
@@ -6,6 +6,8 @@
 #include <cstring>
 #include <cerrno>
 #include <cstdio>
+#include <climits>
+#include <ctime>
 #include <stdexcept>
 #include <iostream>
 #include <chrono>
@@ -13,9 +15,23 @@
 #include <string>
 #include <algorithm>
 #include <functional>
-#include <typeinfo>
 #include <map>
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+#include <optional>
+
+#include "log_queue.hpp"
+#include "log_format.hpp"
+#include "log_binary.hpp"
+#include "log_uring.hpp"
+#include "log_sink.hpp"
+#include "log_limit.hpp"
+#include "log_json.hpp"
+#include "log_module.hpp"
+#include "log_site.hpp"
 
 // Название модуля логирования по умолчанию
 #define LOGGER_NAME 		""
@@ -32,10 +48,32 @@ constexpr uint64_t KB_to_B(uint64_t x) { return ((x) * 1024); };
 
 // Максимальный допустимый размер лог файла для хранения [Байт]
 #define LOG_FILE_MAX_SIZE 	( MB_to_B(2) )		// 2 [MB]
+// Допустимое превышение максимального размера лог-файла, пока следующий файл не подготовлен [Байт]
+#define LOG_FILE_OVERSHOOT	( KB_to_B(16) )
 // Максимальное время ожидания блокировки лог-файла [мс]
 #define LOG_FILE_LOCK_MS	10
 // Максимальное число хранимых лог-файлов после ротации
 #define LOG_FILE_MAX_NUM	3
+// Размер очереди асинхронного режима по умолчанию [Байт]
+#define LOG_ASYNC_QUEUE_SIZE	( MB_to_B(1) )
+// Максимальная длина одной записи бинарного режима [Байт]
+#define LOG_RECORD_MAX_LEN	4096
+// Максимальная длина штампа сообщения [Байт]
+#define LOG_STAMP_MAX_LEN	128
+// Объем буфера отложенных записей при перегрузке (overload_drop_oldest) [Байт]
+#define LOG_BACKLOG_SIZE	( KB_to_B(64) )
+// Предельный объем буфера переполнения (overload_spill) [Байт]
+#define LOG_SPILL_MAX_SIZE	( MB_to_B(16) )
+// Минимальный интервал между сообщениями о потерянных записях [мс]
+#define LOG_DROP_REPORT_MS	1000
+// Размер буфера пакетной записи лог-файла [Байт] и максимальное время хранения записей в нем [мс]
+#define LOG_BATCH_SIZE		( KB_to_B(64) )
+#define LOG_BATCH_FLUSH_MS	100
+// Интервал сброса данных лог-файла на диск по умолчанию (политика sync_interval) [мс]
+#define LOG_SYNC_MS			1000
+// Размер записи бортового самописца [Байт] и число логеров, выводимых обработчиком сигналов
+#define LOG_RECORDER_SLOT_SIZE	256
+#define LOG_RECORDERS_MAX	16
 
 // Коды цветов - подсветки терминала
 #define _RED     			"\x1b[31m"
@@ -64,18 +102,86 @@ constexpr uint64_t KB_to_B(uint64_t x) { return ((x) * 1024); };
 
 #define LOG_LVL_DEFAULT		MSG_ERROR
 
-// Шаблон - обертка для представляения с++ типов в виде с-типов
-template<typename T>
-inline auto to_c(T&& arg) -> decltype(std::forward<T>(arg)) 
+// Максимальный уровень сообщений, включаемых в сборку. Вызовы макросов с более подробным уровнем
+// удаляются компилятором (например, -DLOG_COMPILE_LVL=MSG_DEBUG исключает MSG_VERBOSE и MSG_TRACE)
+#ifndef LOG_COMPILE_LVL
+	#define LOG_COMPILE_LVL	MSG_TRACE
+#endif
+
+// Проверка включения уровня сообщения в сборку
+constexpr bool log_lvl_compiled(log_lvl_t flags) { return (flags & LOG_LVL_BIT_MASK) <= LOG_COMPILE_LVL; }
+
+// Буфер формирования записи текущего потока. Память буфера сохраняется между записями,
+// при вложенном логировании (например, из log_formatter) используется отдельный буфер
+class log_stage
 {
-	return std::forward<T>(arg);
-}
-// Перегрузка шаблона для поддержки вывода std::string как С-строки по ключу %s
-inline const char* to_c(const std::string& s) { return s.c_str(); }
-inline const char* to_c(std::string& s) { return s.c_str(); }
-inline const char* to_c(const bool& b) { return b ? "True" : "False"; }
-inline const char* to_c(bool& b) { return b ? "True" : "False"; }
+public:
+	log_stage(): rec(claim()) {}
+	~log_stage() { if(rec != &spare) tls().busy = false; }
+
+	log_stage(const log_stage&) = delete;
+	log_stage& operator=(const log_stage&) = delete;
+
+	log_buf& buf() { return *rec; }
+
+private:
+	struct tls_t{
+		log_buf buf;
+		bool busy = false;
+	};
 
+	log_buf spare;
+	log_buf *rec;
+
+	static tls_t& tls(){
+		static thread_local tls_t t;
+		return t;
+	}
+
+	log_buf* claim(){
+		tls_t &t = tls();
+		if(t.busy) return &spare;
+
+		t.busy = true;
+		t.buf.clear();
+		return &t.buf;
+	}
+};
+
+class Logging;
+
+// Структурированное событие (см. Logging::event()). Поля записываются по мере вызова kv()
+// в буфер записи потока, запись выводится при уничтожении объекта - в конце выражения:
+//	logger.event(MSG_INFO, "conn_closed").kv("fd", fd).kv("bytes", n);
+// Событие, не прошедшее проверку уровня, поля не формирует
+class log_event
+{
+public:
+	log_event() = default;
+	log_event(const Logging *log, const std::string &mod, log_lvl_t flags, uint8_t dest, const char *name);
+	~log_event() { if(log) finish(); }
+
+	log_event(const log_event&) = delete;
+	log_event& operator=(const log_event&) = delete;
+
+	// Событие будет выведено
+	explicit operator bool() const { return log != nullptr; }
+
+	// Добавление поля key со значением v
+	template<typename T>
+	log_event& kv(std::string_view key, const T &v);
+
+private:
+	const Logging *log = nullptr;			// Логер (nullptr - событие отброшено)
+	log_lvl_t flags = 0;
+	uint8_t dest = 0;						// Назначение записи (0 - бинарный режим)
+	std::optional<log_stage> stage;			// Буфер записи потока
+	log_bin::writer w{nullptr, 0};			// Кодирование в бинарном режиме
+	size_t count_pos = 0;					// Позиция числа полей в бинарной записи
+	uint8_t fields = 0;
+
+	void finish();
+};
 
 // Класс-Интерфейс для управления логированием
 class Logging
@@ -88,6 +194,8 @@ public:
 		only_time,
 		ms_time,
 		custom,
+		us_time,
+		ns_time,
 	}stamp_t;
 
 	Logging() = default;
@@ -96,7 +204,10 @@ public:
 		const std::string &fname = "",
 		uint32_t fnum = LOG_FILE_MAX_NUM,
 		uint64_t fsize = LOG_FILE_MAX_SIZE): 
-			sets(l, mn, fname, fnum, fsize) {}
+			sets(l, mn, fname, fnum, fsize), curr_lvl(l) {}
+
+	// Самописец отключается последним: потоки логера (вывода, статистики, ротации) могут писать в него до завершения
+	~Logging() { set_stats_dump(std::chrono::milliseconds(0)); set_async(false); close_file(); stop_rotation(); set_recorder(0); }
 
 	struct settings{
 		settings() = default;
@@ -121,36 +232,51 @@ public:
 		uint32_t files_num = LOG_FILE_MAX_NUM,
 		uint64_t file_size = LOG_FILE_MAX_SIZE )
 	{
+		close_file();
 		std::lock_guard<std::mutex> lock(log_sets_mutex);
 		sets = {lvl, sets.mod_name, file_name, files_num, file_size};
+		curr_lvl.store(lvl, std::memory_order_relaxed);
 	}
 
 	void init(const settings &s){
+		close_file();
 		std::lock_guard<std::mutex> lock(log_sets_mutex);
 		sets = {s.log_lvl, s.mod_name, s.log_fname, s.max_files_num, s.log_max_fsize};
+		curr_lvl.store(s.log_lvl, std::memory_order_relaxed);
 	}
 
-	// Получение текущего уровня логирования
+	// Получение текущего уровня логирования (без блокировки)
 	log_lvl_t get_lvl() const{
-		std::lock_guard<std::mutex> lock(log_sets_mutex);
-		return sets.log_lvl;
+		return curr_lvl.load(std::memory_order_relaxed);
 	}
 
 	// Установка нового уровня логирования
 	void set_lvl(log_lvl_t new_lvl){
-		std::lock_guard<std::mutex> lock(log_sets_mutex);
-		sets.log_lvl = new_lvl;
+		curr_lvl.store(new_lvl, std::memory_order_relaxed);
 	}
 
-	// Проверка необходимости подготовки сообщения для вывода
-	bool check_lvl(log_lvl_t flags){
-		log_lvl_t curr_lvl = get_lvl();
-		log_lvl_t msg_lvl = flags & LOG_LVL_BIT_MASK;
-		
-		if(!(flags & MSG_TO_FILE) && (curr_lvl < msg_lvl)) return false;
-
-		return true;
+	// Проверка необходимости подготовки сообщения для вывода (с уровнем модуля mod, если он задан)
+	bool check_lvl(log_lvl_t flags) const{
+		return log_lvl_compiled(flags) && passes(flags, get_lvl());
 	}
+	bool check_lvl(const log_module &mod, log_lvl_t flags) const{
+		return log_lvl_compiled(flags) && passes(flags, mod.lvl_or(get_lvl()));
+	}
+
+	// Вывод в терминал: дескриптор fd (STDOUT_FILENO или STDERR_FILENO) и подсветка префиксов записей
+	// макросов logging_*. color_auto - подсветка, если fd является терминалом (проверяется один раз
+	// при вызове). Лог-файл и дополнительные приемники получают записи без подсветки
+	enum color_t : uint8_t { color_auto = 0, color_always, color_never };
+	void set_console(int fd, color_t mode = color_auto);
+	int get_console() const { return console_fd; }
+	bool is_color() const { return console_color; }
+
+	// Подключение дополнительного приемника записей со своим уровнем (вывод в stdout и лог-файл
+	// сохраняется). Запись формируется один раз и передается всем принимающим ее приемникам.
+	// Состав приемников можно изменять во время многопоточного логирования
+	void add_sink(std::shared_ptr<log_sink> sink);
+	void remove_sink(const std::shared_ptr<log_sink> &sink);
+	void clear_sinks();
 
 	// Получение текущего формата временного штампа сообщения
 	stamp_t get_time_stamp() const { return stamp_type; }
@@ -166,7 +292,8 @@ public:
 		log_rotate_arg = arg;
 	}
 
-	// Установка имени модуля при использовании общего логгирования
+	// Установка имени модуля при использовании общего логгирования. Макросы логирования передают
+	// модуль с каждой записью (см. log_module) и имя логера не изменяют
 	void set_module_name(const std::string &new_name) { 
 		// std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex);
 		#ifdef _SHARED_LOG
@@ -174,13 +301,166 @@ public:
 		#endif
 	}
 
+	// Включение (выключение) асинхронного режима: сообщения помещаются в очередь размером queue_size Байт
+	// и выводятся отдельным потоком. Переключение режима следует выполнять до начала многопоточного логирования
+	void set_async(bool enable, size_t queue_size = LOG_ASYNC_QUEUE_SIZE);
+	bool is_async() const { return async_q != nullptr; }
+
+	// Ожидание вывода всех сообщений, помещенных в очередь асинхронного режима к моменту вызова
+	// (в режиме io_uring - и завершения их записи в файл)
+	void flush() const;
+
+	// Включение (выключение) бинарного режима: сообщения записываются в лог-файл без форматирования
+	// (идентификатор формата, время и значения аргументов), вывод в stdout не производится.
+	// Строка формата должна иметь статическое время жизни. Текст восстанавливается утилитой logger-decode
+	void set_binary(bool enable) { close_file(); binary = enable; }
+	bool is_binary() const { return binary; }
+
+	// Включение (выключение) записи через отображение файла в память: лог-файл сразу выделяется
+	// размером log_max_fsize (fallocate) и запись сообщения сводится к копированию в отображение.
+	// Файл обрезается до фактической длины при ротации и закрытии
+	void set_mmap(bool enable) { close_file(); mapped = enable; if(enable) uring_mode = false; }
+	bool is_mmap() const { return mapped; }
+
+	// Включение (выключение) записи лог-файла через io_uring: пишущий поток только копирует запись
+	// в блок, запись блоков выполняется ядром асинхронно (sync - с fdatasync после каждого блока).
+	// При недоступности io_uring используется pwrite(). Режимы mmap и io_uring взаимоисключающие
+	void set_uring(bool enable, bool sync = false) { close_file(); uring_mode = enable; uring_sync = sync; if(enable) mapped = false; }
+	bool is_uring() const { return uring_mode; }
+
+	// Пакетная запись лог-файла: записи накапливаются в буфере размером size Байт и выводятся
+	// одним writev() при заполнении буфера, не реже раза в interval_ms [мс] и сразу после записи
+	// уровня MSG_ERROR (size == 0 - каждая запись выводится своим write()). Режимы mmap и io_uring
+	// накапливают записи сами и буфер не используют. Записи буфера теряются при аварийном завершении
+	void set_batch(size_t size = LOG_BATCH_SIZE, uint32_t interval_ms = LOG_BATCH_FLUSH_MS);
+	size_t get_batch() const { return batch_size; }
+
+	// Политика сброса данных лог-файла на диск (fdatasync). Флаги объединяются
+	enum sync_t : uint8_t {
+		sync_never = 0,			// сброс выполняет ОС (по умолчанию)
+		sync_interval = 1 << 0,	// не реже раза в interval_ms [мс], если файл изменялся
+		sync_error = 1 << 1,	// после каждой записи уровня MSG_ERROR
+	};
+	void set_sync(uint8_t policy, uint32_t interval_ms = LOG_SYNC_MS);
+	uint8_t get_sync() const { return sync_policy; }
+
+	// Поведение при перегрузке: лог-файл занят дольше LOG_FILE_LOCK_MS или заполнена очередь асинхронного режима
+	enum overload_t : uint8_t {
+		overload_block = 0,		// ожидание без ограничения времени
+		overload_drop_newest,	// отбрасывание новой записи (по умолчанию)
+		overload_drop_oldest,	// запись откладывается в буфер ограниченного объема, при заполнении вытесняются старые
+		overload_spill,			// запись откладывается в буфер переполнения, растущий до предельного объема
+		overload_num
+	};
+
+	// Установка политики перегрузки. size - объем буфера отложенных записей [Байт]
+	// (0 - LOG_BACKLOG_SIZE для overload_drop_oldest, LOG_SPILL_MAX_SIZE для overload_spill).
+	// Отложенные записи выводятся первым потоком, получившим лог-файл, а также при flush() и закрытии файла.
+	// Заполненная очередь асинхронного режима по умолчанию ожидает освобождения места (без потерь),
+	// политика применяется к ней только после явного вызова set_overload()
+	void set_overload(overload_t policy, size_t size = 0);
+	overload_t get_overload() const { return overload.load(std::memory_order_relaxed); }
+
+	// Статистика работы логера. Счетчики ведутся каждым потоком отдельно и суммируются при чтении
+	struct stats_t{
+		// Число интервалов гистограмм: интервал k содержит длительности [2^k, 2^(k+1)) нс
+		static constexpr size_t hist_size = 32;
+		static constexpr size_t lvl_num = MSG_TRACE + 1;
+
+		// Причины потери записей
+		enum drop_t : uint8_t {
+			drop_lock_timeout = 0,	// истекло время ожидания блокировки лог-файла
+			drop_open_failed,		// лог-файл не удалось открыть
+			drop_write_failed,		// ошибка или неполная запись
+			drop_too_long,			// запись не помещается в буфер бинарного режима или в отображенный файл
+			drop_no_space,			// лог-файл заполнен (с учетом LOG_FILE_OVERSHOOT), а следующий не готов
+			drop_queue_full,		// очередь асинхронного режима заполнена (overload_drop_newest)
+			drop_overflow,			// запись вытеснена из буфера отложенных записей или не поместилась в него
+			drop_num
+		};
+
+		uint64_t emitted[lvl_num] = {};			// выведенные записи по уровням (0 - только в файл)
+		uint64_t dropped[drop_num] = {};		// потерянные записи по причинам
+		uint64_t bytes_stdout = 0;				// выведено в stdout [Байт]
+		uint64_t bytes_file = 0;				// записано в лог-файл [Байт]
+		uint64_t rotations = 0;					// число ротаций лог-файла
+		uint64_t records_file = 0;				// записи, выведенные в лог-файл
+		uint64_t writes_file = 0;				// системные вызовы записи лог-файла (write, writev)
+		uint64_t syncs_file = 0;				// вызовы fdatasync лог-файла
+		uint64_t overload[overload_num] = {};	// число перегрузок по примененной политике
+		uint64_t lock_wait[hist_size] = {};		// гистограмма ожидания блокировки лог-файла
+		uint64_t write_time[hist_size] = {};	// гистограмма длительности записи в лог-файл
+
+		uint64_t total_emitted() const;
+		uint64_t total_dropped() const;
+
+		// Верхняя граница интервала гистограммы, в который попадает квантиль q [нс] (0 - без ожидания)
+		static uint64_t percentile(const uint64_t (&hist)[hist_size], double q);
+	};
+
+	// Получение статистики (сумма счетчиков всех потоков на момент вызова)
+	stats_t stats() const;
+
+	// Периодический вывод статистики сообщением с флагами flags (period == 0 - выключение)
+	void set_stats_dump(std::chrono::milliseconds period, log_lvl_t flags = MSG_INFO | MSG_TO_FILE);
+
+	// Бортовой самописец: кольцевой буфер последних slots сообщений (0 - выключение) уровня не выше lvl,
+	// в том числе не прошедших проверку уровня логера. Сообщения сохраняются без форматирования
+	// (строка формата и значения аргументов), без блокировок и ввода-вывода.
+	// Включение (выключение) следует выполнять до начала многопоточного логирования
+	void set_recorder(size_t slots, log_lvl_t lvl = MSG_TRACE);
+
+	// Вывод содержимого самописца в файл path (nullptr - <log_fname>.flight) в формате бинарного режима
+	// (текст восстанавливается logger-decode). Допускается вызов из обработчика сигнала
+	bool dump_recorder(const char *path = nullptr) const;
+
+	// Установка обработчиков SIGSEGV, SIGABRT (вывод самописцев всех логеров и завершение процесса)
+	// и SIGUSR1 (вывод без завершения)
+	static void install_crash_handler();
+
+	// Переоткрытие лог-файла (например, после его перемещения внешней утилитой типа logrotate)
+	void reopen() const { close_file(); }
+
 	// Запись сообщения в лог-файл
 	template<typename... Args>
-	int to_file(const char *stamp, const char *fmt, Args&&... args) const;
+	int to_file(const char *stamp, const char *fmt, const Args&... args) const;
 
-	// Шаблонная версия форматированного вывода с переменным кол-вом параметров
+	// Шаблонная версия форматированного вывода с переменным кол-вом параметров.
+	// Строка формата разбирается при каждом вызове, типы аргументов проверяются во время выполнения
 	template<typename... Args>
-	int msg(log_lvl_t flags, const char *fmt, Args&&... args) const;
+	int msg(log_lvl_t flags, const char *fmt, const Args&... args) const;
+
+	// Вывод по строке формата LOG_FMT("..."): разбор формата и проверка типов аргументов выполняются при компиляции
+	template<typename F, typename... Args>
+	typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+	msg(log_lvl_t flags, F fmt, const Args&... args) const;
+
+	// Вывод с заданным для этой записи типом штампа (настройки логера не изменяются)
+	template<typename F, typename... Args>
+	typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+	msg(log_lvl_t flags, stamp_t stamp, F fmt, const Args&... args) const;
+
+	// Вывод от имени модуля mod: уровень модуля (если задан) заменяет уровень логера,
+	// имя модуля (если не пустое) - имя логера в штампе записи
+	template<typename F, typename... Args>
+	typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+	msg(const log_module &mod, log_lvl_t flags, F fmt, const Args&... args) const;
+
+	template<typename F, typename... Args>
+	typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+	msg(const log_module &mod, log_lvl_t flags, stamp_t stamp, F fmt, const Args&... args) const;
+
+	// Вывод по строке формата места вызова, заданной во время выполнения (см. LOG_SITE_ARG):
+	// формат разбирается при каждом вызове, строка без аргументов выводится как есть
+	template<typename... Args>
+	int msg(const log_module &mod, log_lvl_t flags, const log_site_rt &fmt, const Args&... args) const {
+		return this->print_rt(&mod, flags, stamp_type, fmt, args...);
+	}
+
+	template<typename... Args>
+	int msg(const log_module &mod, log_lvl_t flags, stamp_t stamp, const log_site_rt &fmt, const Args&... args) const {
+		return this->print_rt(&mod, flags, stamp, fmt, args...);
+	}
 
 	// Перегрузка для поддержки неформатированного вывода без предупреждений компилятора
 	int msg(log_lvl_t flags, const std::string &str) const {
@@ -191,17 +471,42 @@ public:
 		return msg(flags, "%s", str);
 	}
 
+	// Структурированное событие name с полями, добавляемыми вызовами kv(). Проверка уровня,
+	// дополнительные приемники, ротация и асинхронный режим - общие с msg(). Запись выводится
+	// строкой JSON, в бинарном режиме - записью события (имя должно иметь статическое время жизни).
+	// Поля кодируются в буфер записи потока без выделения динамической памяти
+	log_event event(log_lvl_t flags, const char *name) const { return this->start_event(nullptr, flags, name); }
+	log_event event(const log_module &mod, log_lvl_t flags, const char *name) const { return this->start_event(&mod, flags, name); }
+
 	// Дамп блока памяти в 16-ричном формате
 	void hex_dump(log_lvl_t flags, const char *buf, size_t len, const std::string &msg_str = "", uint8_t delim = 16);
 	void hex_dump(log_lvl_t flags, const uint8_t *buf, size_t len, const std::string &msg = "", uint8_t delim = 16);
+	void hex_dump(const log_module &mod, log_lvl_t flags, const char *buf, size_t len, const std::string &msg_str = "", uint8_t delim = 16);
+	void hex_dump(const log_module &mod, log_lvl_t flags, const uint8_t *buf, size_t len, const std::string &msg = "", uint8_t delim = 16);
+
+	// Дамп от места вызова F (см. LOG_SITE, logging_hexdump): отключенное место вызова не выводится,
+	// включенное - выводится независимо от уровня логера и модуля
+	template<typename F>
+	typename std::enable_if<log_site_text::has_ctl<F>::value>::type
+	hex_dump(const log_module &mod, log_lvl_t flags, F, const void *buf, size_t len, const std::string &msg = "", uint8_t delim = 16){
+		log_site_ctl::mode_t site_mode = F::ctl().mode(F::site());
+		if(site_mode == log_site_ctl::mode_off) return;
+		dump_hex(&mod, flags, static_cast<const uint8_t*>(buf), len, msg, delim, site_mode);
+	}
 
 	// Формирование штампа сообщения
 	static std::string make_msg_stamp(stamp_t type, const std::string &module_name, const char *fmt = "");
+	// Формирование штампа сообщения в буфер buf размером size (для текущего времени или заданного spec).
+	// Возвращает длину штампа
+	static size_t make_msg_stamp(char *buf, size_t size, stamp_t type, const std::string &module_name, const char *fmt = "");
+	static size_t make_msg_stamp(char *buf, size_t size, const struct timespec &spec, stamp_t type, 
+		const std::string &module_name, const char *fmt = "");
 
 	// Добивка строки до нужного размера символами pad и централизация
 	static std::string padding(int col_size, const std::string &s, const char pad = ' ');
 
-	// Мьютекс для целостного вывода сообщений в stdout (в том числе комбинированных)
+	// Мьютекс для целостного вывода комбинированных сообщений (из нескольких вызовов msg()).
+	// Одиночные записи выводятся целиком одним write() и блокировки не требуют
 	static std::recursive_mutex log_print_mutex; 
 	
 private:
@@ -210,129 +515,537 @@ private:
 	const char *stamp_fmt = "[ %d.%m.%y %T ]";	// Формат вывода времени в штампе сообщения
 	stamp_t stamp_type = Logging::date_time;	// Тип формата вывода времени в штампе сообщения
 	mutable std::mutex log_sets_mutex;			// Мьютекс доступа к текущим настройкам 
+	std::atomic<log_lvl_t> curr_lvl{LOG_LVL_DEFAULT};	// Текущий уровень логирования (копия sets.log_lvl)
 	mutable std::recursive_timed_mutex log_file_mutex;	// Мьютекс доступа к лог-файлу
 	mutable uint32_t curr_file_num = 1;			// Текущее число лог файлов
+	mutable int log_fd = -1;					// Открытый лог-файл (открывается при первой записи)
+	mutable uint64_t log_fsize = 0;				// Текущий размер лог-файла [Байт]
+	bool binary = false;						// Бинарный режим записи (отложенное форматирование)
+	mutable log_buf session_buf;				// Заголовок сессии бинарного лог-файла (память сохраняется между ротациями)
+	mutable uint32_t bin_defined = 0;			// Число строк реестра, определенных в текущей сессии бинарного лог-файла
+	mutable log_buf define_buf;					// Определения строк, выводимые перед очередной записью
+	mutable uint32_t define_from = 0;			// Строки реестра в define_buf: [define_from, define_num)
+	mutable uint32_t define_num = 0;
+	size_t batch_size = 0;						// Размер буфера пакетной записи (0 - без накопления)
+	uint32_t batch_ms = LOG_BATCH_FLUSH_MS;		// Максимальное время хранения записей в буфере [мс]
+	std::unique_ptr<char[]> batch_buf;			// Буфер пакетной записи
+	mutable size_t batch_used = 0;				// Заполнение буфера пакетной записи [Байт]
+	uint8_t sync_policy = sync_never;			// Политика сброса данных на диск (sync_t)
+	uint32_t sync_ms = LOG_SYNC_MS;				// Интервал сброса данных на диск [мс]
+	mutable bool sync_dirty = false;			// Лог-файл изменялся после последнего сброса на диск
+	mutable std::chrono::steady_clock::time_point synced_at;	// Время последнего сброса на диск
+	bool mapped = false;						// Запись через отображение файла в память
+	mutable char *log_map = nullptr;			// Отображение открытого лог-файла (режим mapped)
+	bool uring_mode = false;					// Запись через io_uring
+	bool uring_sync = false;					// fdatasync после записи каждого блока (режим io_uring)
+	mutable std::unique_ptr<log_uring> uring;	// Очередь записи открытого лог-файла (режим io_uring)
 
 	log_file_rotate_cb log_rotate = nullptr;	// Колбек переполнения максимального размера лог-файта
 	void *log_rotate_arg = nullptr;				// Параметр колбек ф-ии переполнения лог-файла
 
-	// Получение текущего размера лог-файла
-	static uint64_t get_file_size(const std::string &fname);
+	// Назначение записи (в том числе в очереди асинхронного режима). Старшие биты хранят
+	// уровень сообщения для фильтрации дополнительными приемниками и пакетной записи
+	enum : uint8_t {
+		dest_stdout = 1 << 0,
+		dest_file = 1 << 1,
+		dest_sinks = 1 << 2,
+		dest_lvl_shift = 4
+	};
+
+	// Дополнительные приемники записей. Список не изменяется: при изменении состава он заменяется копией,
+	// поток, выводящий запись, получает снимок (std::atomic_load) один раз. Проверка уровня выполняется
+	// по максимальному уровню приемников без снимка и блокировок
+	using sink_list = std::vector<std::shared_ptr<log_sink>>;
+	std::shared_ptr<const sink_list> sinks;
+	mutable std::mutex sinks_mutex;					// Мьютекс изменения состава приемников и расчета уровня
+	mutable std::atomic<log_lvl_t> sinks_lvl{0};	// Максимальный уровень приемников (0 - нет приемников)
+	mutable std::atomic<uint32_t> sinks_epoch{0};	// Значение log_sink::epoch() при расчете sinks_lvl
+	int console_fd = 1;								// Дескриптор вывода в терминал (stdout)
+	bool console_color = Logging::is_tty(1);		// Подсветка префиксов записей в терминале
+
+	// Сообщение с флагами flags выводится при уровне curr_lvl (в терминал, в файл или в приемники)
+	bool passes(log_lvl_t flags, log_lvl_t curr_lvl) const {
+		log_lvl_t msg_lvl = flags & LOG_LVL_BIT_MASK;
+		return (flags & MSG_TO_FILE) || (curr_lvl >= msg_lvl) || sinks_accept(msg_lvl);
+	}
+
+	// Уровень и имя источника записи: модуль mod (nullptr - сам логер)
+	log_lvl_t lvl_of(const log_module *mod) const { return mod ? mod->lvl_or(get_lvl()) : get_lvl(); }
+	const std::string& name_of(const log_module *mod) const {
+		return (mod && !mod->name().empty()) ? mod->name() : sets.mod_name;
+	}
+
+	// Назначение записи с флагами flags при уровне логера curr_lvl
+	uint8_t dest_of(log_lvl_t flags, log_lvl_t curr_lvl) const {
+		log_lvl_t msg_lvl = flags & LOG_LVL_BIT_MASK;
+		uint8_t dest = 0;
+
+		// Проверка уровня сообщения для вывода в терминал
+		// (игнорируем сообщения только для записи в файл и с уровнем выше заданного допустимого)
+		if(msg_lvl && msg_lvl <= curr_lvl) dest |= dest_stdout;
+		if((flags & MSG_TO_FILE) && sets.log_fname != "" && sets.log_max_fsize) dest |= dest_file;
+		if(sinks_accept(msg_lvl)) dest |= dest_sinks;
+		return dest | dest_lvl(flags);
+	}
+
+	// Уровень сообщения в битах назначения записи
+	static uint8_t dest_lvl(log_lvl_t flags) { return (uint8_t)(std::min<log_lvl_t>(flags & LOG_LVL_BIT_MASK, 0x0F) << dest_lvl_shift); }
+
+	// Сообщение уровня msg_lvl принимается хотя бы одним дополнительным приемником
+	bool sinks_accept(log_lvl_t msg_lvl) const {
+		if(sinks_epoch.load(std::memory_order_acquire) != log_sink::epoch()) this->update_sinks_lvl();
+		return msg_lvl && msg_lvl <= sinks_lvl.load(std::memory_order_relaxed);
+	}
+	// Пересчет максимального уровня приемников
+	void update_sinks_lvl() const;
+	// Вывод записи в дополнительные приемники
+	void write_sinks(uint8_t dest, const char *rec, size_t len) const;
+
+	std::unique_ptr<log_ring> async_q;			// Очередь асинхронного режима
+	std::thread async_thread;					// Поток вывода сообщений из очереди
+	std::atomic<bool> async_stop{false};		// Признак завершения потока вывода
+	mutable std::atomic<bool> async_idle{false};// Поток вывода ожидает новых сообщений
+	mutable std::mutex async_mutex;				// Мьютекс ожидания потока вывода и flush()
+	mutable std::condition_variable async_cv;	// Пробуждение потока вывода
+	mutable std::condition_variable flush_cv;	// Оповещение об опустошении очереди
+
+	// Ротация выполняется фоновым потоком: следующий лог-файл открывается заранее,
+	// пишущий поток только переключается на него, а переименование файлов и колбек
+	// ротации выполняются в фоне. Следующий и заполненный файлы передаются под handoff_mutex
+	// (поток ротации не захватывает блокировку лог-файла, пишущие потоки - сначала ее, затем handoff_mutex)
+	mutable std::mutex handoff_mutex;			// Мьютекс передачи файлов между пишущими потоками и потоком ротации
+	mutable bool handoff_open = false;			// Лог-файл открыт (для потока ротации)
+	mutable int next_fd = -1;					// Заранее открытый следующий лог-файл
+	mutable char *next_map = nullptr;			// Отображение следующего лог-файла
+	mutable int retired_fd = -1;				// Заполненный лог-файл, ожидающий завершения ротации
+	mutable char *retired_map = nullptr;		// Отображение заполненного лог-файла
+	mutable uint64_t retired_size = 0;			// Фактическая длина заполненного лог-файла [Байт]
+	mutable std::atomic<bool> next_requested{false};	// Подготовка следующего лог-файла запрошена
+	mutable std::thread rotate_thread;			// Поток ротации (запускается при первой необходимости)
+	mutable std::mutex rotate_mutex;			// Мьютекс состояния потока ротации
+	mutable std::condition_variable rotate_cv;	// Оповещение о новой задаче и ее завершении
+	mutable bool rotate_pending = false;		// Задача ротации ожидает выполнения
+	mutable bool rotate_busy = false;			// Задача ротации выполняется
+	mutable bool rotate_stop = false;			// Признак завершения потока ротации
+
+	// Счетчики статистики одного потока. Изменяются только потоком-владельцем (без атомарных
+	// операций чтения-модификации), читаются при суммировании в stats()
+	struct stats_block{
+		using counter = std::atomic<uint64_t>;
+
+		std::thread::id owner;
+		counter emitted[stats_t::lvl_num]{};
+		counter dropped[stats_t::drop_num]{};
+		counter bytes_stdout{0};
+		counter bytes_file{0};
+		counter rotations{0};
+		counter records_file{0};
+		counter writes_file{0};
+		counter syncs_file{0};
+		counter overload[overload_num]{};
+		counter lock_wait[stats_t::hist_size]{};
+		counter write_time[stats_t::hist_size]{};
+
+		static void add(counter &c, uint64_t n = 1) { c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+		static void hist(counter (&h)[stats_t::hist_size], uint64_t ns);
+	};
+
+	const uint64_t stats_id = next_stats_id();	// Идентификатор логера в кэше счетчиков потоков
+	mutable std::mutex stats_mutex;				// Мьютекс списка счетчиков потоков
+	mutable std::vector<std::unique_ptr<stats_block>> stats_blocks;	// Счетчики потоков
+
+	std::thread stats_thread;					// Поток периодического вывода статистики
+	std::mutex stats_dump_mutex;
+	std::condition_variable stats_dump_cv;
+	bool stats_dump_stop = false;
+
+	std::atomic<overload_t> overload{overload_drop_newest};	// Политика перегрузки (изменяется под backlog_mutex)
+	std::atomic<bool> queue_overload{false};	// Политика применяется к очереди асинхронного режима (задана явно)
+	mutable std::mutex backlog_mutex;			// Мьютекс буфера отложенных записей
+	mutable log_backlog backlog;				// Записи, отложенные при перегрузке
+	mutable log_backlog backlog_out;			// Выводимые отложенные записи (под блокировкой лог-файла)
+	mutable std::atomic<size_t> backlog_num{0};	// Число отложенных записей
+
+	mutable std::atomic<uint64_t> drops_pending{0};	// Потерянные записи, о которых не было сообщения
+	mutable std::atomic<int64_t> drops_reported{0};	// Время последнего сообщения о потерях [мс]
+
+	// Обработка записи, не выведенной из-за перегрузки (reason - причина потери при overload_drop_newest).
+	// Возвращает длину отложенной записи или 0
+	int overloaded(uint8_t dest, const char *rec, size_t len, stats_t::drop_t reason) const;
+	// Вывод отложенных записей (под блокировкой лог-файла)
+	void drain_backlog(std::unique_lock<std::recursive_timed_mutex> &lock) const;
+	// Сообщение о потерянных записях (не чаще LOG_DROP_REPORT_MS)
+	void report_drops() const;
+
+	// Запись бортового самописца. Поле seq защищает запись от чтения во время изменения:
+	// 2 * pos + 1 - запись заполняется, 2 * pos + 2 - запись с позиции pos готова
+	struct rec_slot{
+		std::atomic<uint64_t> seq{0};
+		struct timespec spec;
+		const char *fmt;				// строка формата со статическим временем жизни (nullptr - копия в data)
+		log_lvl_t flags;
+		uint8_t stamp;
+		uint16_t fmt_end;				// конец копии строки формата в data
+		uint16_t len;					// длина data
+		char data[LOG_RECORDER_SLOT_SIZE - 40];	// [копия формата (len text)], число и значения аргументов
+	};
+	static_assert(sizeof(rec_slot) == LOG_RECORDER_SLOT_SIZE, "recorder slot size");
+
+	std::unique_ptr<rec_slot[]> rec_slots;
+	rec_slot *recorder = nullptr;				// Самописец включен
+	size_t rec_mask = 0;
+	log_lvl_t rec_lvl = MSG_TRACE;
+	mutable std::atomic<uint64_t> rec_pos{0};	// Позиция следующей записи
+	char rec_path[512] = {0};					// Файл вывода по умолчанию
+	char rec_mod[64] = {0};						// Имя модуля на момент включения
+
+	static std::atomic<const Logging*> recorders[LOG_RECORDERS_MAX];	// Логеры, выводимые обработчиком сигналов
+
+	// Сохранение сообщения в самописце. Строка формата fmt_static (статическое время жизни) сохраняется
+	// указателем и выводится при dump_recorder(), иначе копируется в запись
+	template<typename... Args>
+	void record(log_lvl_t flags, stamp_t stamp, const char *fmt, bool fmt_static, const Args&... args) const;
+	rec_slot& rec_begin(uint64_t &pos) const;
+	void rec_commit(rec_slot &slot, uint64_t pos, log_lvl_t flags, stamp_t stamp, log_bin::writer &w, const char *fmt) const;
+	static void crash_handler(int sig);
+
+	static uint64_t next_stats_id();
+	// Счетчики текущего потока
+	stats_block& local_stats() const;
+	void count_emitted(log_lvl_t flags) const;
+	void count_dropped(stats_t::drop_t reason) const;
+
+	// Дописывание к записи числа пропущенных в месте вызова записей (см. log_limit)
+	static void add_suppressed(log_buf &rec, const log_site *site);
+
+	// Подсветка записи для терминала: префикс без подсветки (plain_len Байт с позиции at)
+	// заменяется при выводе префиксом места вызова с подсветкой (см. log_site)
+	struct rec_color{
+		const char *text;
+		size_t len;
+		size_t at;
+		size_t plain_len;
+	};
+
+	// Вывод записи в терминал (с подсветкой color, если задана)
+	void write_stdout(const char *rec, size_t len, const rec_color *color = nullptr) const;
+	static bool is_tty(int fd);
+
+	// Получение текущего размера открытого лог-файла
+	static uint64_t get_file_size(int fd);
+
+	// Получение лог-файла для записи данных длиной need Байт: открытие при первом обращении
+	// и ротация при превышении максимального размера
+	int open_file(size_t need = 0) const;
+	// Данные длиной need не помещаются в текущий лог-файл: отображенный - в пределах log_max_fsize,
+	// обычный - с превышением LOG_FILE_OVERSHOOT (в пустой файл помещается запись любой длины)
+	bool over_limit(size_t need) const {
+		if(log_map) return log_fsize + need > sets.log_max_fsize;
+		return log_fsize && log_fsize + need > sets.log_max_fsize + LOG_FILE_OVERSHOOT;
+	}
+
+	// Открытие (в режиме mapped - выделение и отображение) и закрытие лог-файла
+	int open_log(const char *name, bool trunc, char *&map, uint64_t &used) const;
+	void close_log(int fd, char *map, uint64_t used) const;
+
+	// Добавление данных в конец открытого лог-файла
+	size_t append(const char *buf, size_t len, bool urgent = false) const;
+
+	// Пакетная запись: вывод буфера (вместе с записью rec) одним writev(), сброс данных на диск
+	// и периодическое обслуживание файла потоком ротации (при захваченной блокировке лог-файла)
+	size_t flush_batch(const char *rec = nullptr, size_t len = 0) const;
+	void sync_file() const;
+	void service_file() const;
+	uint32_t service_period() const;
+
+	// Режим io_uring: отправка накопленных данных, ожидание завершения записи
+	void submit_file() const;
+	void drain_file() const;
+
+	// Закрытие лог-файла (будет открыт заново при следующей записи)
+	void close_file() const;
+
+	// Ротация лог-файла: постановка задачи, ожидание ее завершения, поток ротации
+	// (имена следующего файла и бэкапов формируются в буфере вызывающего без выделения памяти)
+	const char* next_file_name(char (&name)[PATH_MAX]) const {
+		std::snprintf(name, sizeof name, "%s.next", sets.log_fname.c_str());
+		return name;
+	}
+	const char* backup_file_name(char (&name)[PATH_MAX], uint32_t num) const {
+		std::snprintf(name, sizeof name, "%s.%u", sets.log_fname.c_str(), num);
+		return name;
+	}
+	void request_rotation() const;
+	void start_rotation() const;
+	void wait_rotation() const;
+	bool wait_rotation(std::chrono::milliseconds timeout) const;
+	void stop_rotation();
+	void rotate_worker() const;
+	void finish_rotation(int old_fd, char *old_map, uint64_t old_size) const;
+	void prepare_next_file() const;
+
+	// Бинарный режим: начало сессии в лог-файле, кодирование и запись сообщения
+	void begin_binary_session() const;
+	size_t bin_defines() const;
+	void bin_header(log_bin::writer &w, const std::string &mod, log_lvl_t flags, stamp_t stamp, const char *fmt) const;
+	int write_binary(log_lvl_t flags, const char *rec, size_t len) const;
+	template<typename... Args>
+	int to_binary(const log_module *mod, log_lvl_t flags, stamp_t stamp, const char *fmt, const Args&... args) const;
+
+	// Вывод по строке формата LOG_FMT() от имени модуля mod (nullptr - сам логер)
+	template<typename F, typename... Args>
+	int print(const log_module *mod, log_lvl_t flags, stamp_t stamp, F fmt, const Args&... args) const;
+	template<typename... Args>
+	int print_rt(const log_module *mod, log_lvl_t flags, stamp_t stamp, const log_site_rt &fmt, const Args&... args) const;
+	static void format_site(log_buf &out, const log_site_rt &fmt, const log_fmt::arg_ref *args, size_t nargs);
+	void dump_hex(const log_module *mod, log_lvl_t flags, const uint8_t *buf, size_t len, const std::string &msg_str, uint8_t delim,
+		log_site_ctl::mode_t site_mode = log_site_ctl::mode_default) const;
+	log_event start_event(const log_module *mod, log_lvl_t flags, const char *name) const;
+
+	// Запись в лог-файл сформированной записи уровня lvl
+	int write_file(const char *rec, size_t len, log_lvl_t lvl) const;
+	// Запись при захваченной блокировке лог-файла
+	int write_locked(std::unique_lock<std::recursive_timed_mutex> &lock, const char *rec, size_t len, log_lvl_t lvl) const;
+
+	// Формирование записи (штамп + текст, выводимый body) и ее вывод по назначению
+	// (site - место вызова с подготовленным префиксом для терминала, nullptr - без места вызова)
+	template<typename Body>
+	int emit(const log_module *mod, log_lvl_t flags, log_lvl_t curr_lvl, stamp_t stamp, Body &&body,
+		const log_site *site = nullptr) const;
+	void write_record(uint8_t dest, const char *rec, size_t len, const rec_color *color = nullptr) const;
+
+	// Помещение сформированной записи в очередь асинхронного режима
+	void enqueue(uint8_t dest, const char *rec, size_t len, const rec_color *color = nullptr) const;
+	// Пробуждение ожидающего потока вывода
+	void wake_writer() const;
+
+	// Поток вывода сообщений асинхронного режима
+	void async_writer();
+
+	friend class log_event;
 };
 
 
 template<typename... Args>
-int Logging::to_file(const char *stamp, const char *fmt, Args&&... args) const
+int Logging::to_file(const char *stamp, const char *fmt, const Args&... args) const
 {
 	if( sets.log_fname == "" || !sets.log_max_fsize ) return 0;
 
-	int ret = 0;
-	std::FILE *logfp = nullptr;
-	bool rotated = false;
-
-	// Синхронизировать доступ к файлу с таймаутом LOG_FILE_LOCK_MS мс (файл может быть недоступен)
-	std::unique_lock<std::recursive_timed_mutex> lock(log_file_mutex, std::defer_lock);
-	if(!lock.try_lock_for(std::chrono::milliseconds(LOG_FILE_LOCK_MS))) return 0;
-
-	uint64_t file_size = Logging::get_file_size(sets.log_fname);
-
-	// Если ошибка определения размера файла или максимальный размер превышен - перезапись файла
-	if( file_size >= sets.log_max_fsize ){
-		msg(MSG_VERBOSE, "------ Rotating '%s' file ------\n", sets.log_fname);
-		if(log_rotate) {
-			try{
-				log_rotate(log_rotate_arg);
-			}
-			catch(const std::exception &e){
-				msg(MSG_ERROR, "log_rotate() failed: %s\n", e.what());
-			}
-		}
-
-		// Процедура создания бэкапа лог-файла
-		if(sets.max_files_num){
-			std::string backup_name = sets.log_fname + "." + std::to_string(curr_file_num);
-			std::rename(sets.log_fname.c_str(), backup_name.c_str());
-			curr_file_num = (curr_file_num >= sets.max_files_num) ? 1 : curr_file_num + 1;
-		}
-
-		logfp = fopen(sets.log_fname.c_str(), "w+");
-		rotated = true;
-    }
-	else logfp = std::fopen(sets.log_fname.c_str(), "a+");
-
-	if(logfp){
-		if(rotated) std::fprintf(logfp, "%s ----- Log file has been rotated -----\n", stamp);
-		if(stamp) std::fprintf(logfp, "%s", stamp);
-		ret = std::fprintf(logfp, fmt, to_c(args)...); 
-		std::fclose(logfp);
-	}
-	else {
-		// log_perr("Couldnt open log file '%s'", sets.log_fname); 
-	}
+	log_stage stage;
+	log_buf &rec = stage.buf();
+	if(stamp) rec.append(stamp);
+	size_t stamp_len = rec.size();
+	log_fmt::format(rec, fmt, args...);
 
-	return ret;
+	if(!this->write_file(rec.data(), rec.size(), MSG_SILENT)) return 0;
+	return (int)(rec.size() - stamp_len);
 }
 
 template<typename... Args>
-int Logging::msg(log_lvl_t flags, const char *fmt, Args&&... args) const
+int Logging::msg(log_lvl_t flags, const char *fmt, const Args&... args) const
 {
-	// Если не предоставлено имя модуля
-	// if(mod_name == "")) return 0;
+	// Уровень исключен из сборки (при постоянном flags проверка выполняется компилятором)
+	if(!log_lvl_compiled(flags)) return 0;
+
+	if(recorder) this->record(flags, stamp_type, fmt, false, args...);
 
-	int ret = 0;
-	std::string msg_stamp;
-	
 	log_lvl_t curr_lvl = this->get_lvl();
-	log_lvl_t msg_lvl = flags & LOG_LVL_BIT_MASK;
 	// Проверка необходимости подготовки сообщения для вывода
-	if(!(flags & MSG_TO_FILE) && (curr_lvl < msg_lvl)) return 0;
+	if(!passes(flags, curr_lvl)) return 0;
 
-	// Синхронизация формирования сообщения и вывода в stdout
-	{
-		std::lock_guard<std::recursive_mutex> lock(log_print_mutex);
+	// В бинарном режиме форматирование не выполняется
+	if(binary) return this->to_binary(nullptr, flags, stamp_type, fmt, args...);
 
-		// Создание форматированной метаинформации о сообщении
-		msg_stamp = Logging::make_msg_stamp(stamp_type, sets.mod_name, stamp_fmt);
+	return this->emit(nullptr, flags, curr_lvl, stamp_type, [&](log_buf &out){ log_fmt::format(out, fmt, args...); });
+}
 
-		// Проверка уровня сообщения для вывода в терминал
-		// (игнорируем сообщения только для записи в файл и с уровнем выше заданного допустимого)
-		if(msg_lvl && msg_lvl <= curr_lvl){
-			std::printf("%s", msg_stamp.c_str());
-			ret = std::printf(fmt, to_c(args)...);
-		}
+template<typename F, typename... Args>
+typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+Logging::msg(log_lvl_t flags, F fmt, const Args&... args) const
+{
+	return this->msg(flags, stamp_type, fmt, args...);
+}
+
+template<typename F, typename... Args>
+typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+Logging::msg(log_lvl_t flags, stamp_t stamp, F fmt, const Args&... args) const
+{
+	return this->print(nullptr, flags, stamp, fmt, args...);
+}
+
+template<typename F, typename... Args>
+typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+Logging::msg(const log_module &mod, log_lvl_t flags, F fmt, const Args&... args) const
+{
+	return this->print(&mod, flags, stamp_type, fmt, args...);
+}
+
+template<typename F, typename... Args>
+typename std::enable_if<log_fmt::is_fmt_string<F>::value, int>::type
+Logging::msg(const log_module &mod, log_lvl_t flags, stamp_t stamp, F fmt, const Args&... args) const
+{
+	return this->print(&mod, flags, stamp, fmt, args...);
+}
+
+template<typename F, typename... Args>
+int Logging::print(const log_module *mod, log_lvl_t flags, stamp_t stamp, F fmt, const Args&... args) const
+{
+	if(!log_lvl_compiled(flags)) return 0;
+
+	// Режим места вызова (log_site_ctl): отключенное место вызова не выводится,
+	// включенное - выводится независимо от уровня логера и модуля
+	log_site_ctl::mode_t site_mode = log_site_ctl::mode_default;
+	if constexpr (log_site_text::has_ctl<F>::value){
+		site_mode = F::ctl().mode(F::site());
+		if(site_mode == log_site_ctl::mode_off) return 0;
 	}
-	
-	// Проверка необходимости записи сообщения в файл
-	if(flags & MSG_TO_FILE){
-		ret = this->to_file(msg_stamp.c_str(), fmt, args...);
+
+	if(recorder) this->record(flags, stamp, F::str(), true, args...);
+
+	log_lvl_t curr_lvl = this->lvl_of(mod);
+	if(site_mode == log_site_ctl::mode_on) curr_lvl = std::max<log_lvl_t>(curr_lvl, flags & LOG_LVL_BIT_MASK);
+	if(!passes(flags, curr_lvl)) return 0;
+
+	if(binary) return this->to_binary(mod, flags, stamp, F::str(), args...);
+
+	return this->emit(mod, flags, curr_lvl, stamp, [&](log_buf &out){ log_fmt::format(out, fmt, args...); },
+		log_site_text::site_of<F>());
+}
+
+template<typename... Args>
+int Logging::print_rt(const log_module *mod, log_lvl_t flags, stamp_t stamp, const log_site_rt &fmt, const Args&... args) const
+{
+	if(!log_lvl_compiled(flags)) return 0;
+
+	log_site_ctl::mode_t site_mode = fmt.ctl.mode(fmt.site);
+	if(site_mode == log_site_ctl::mode_off) return 0;
+
+	const log_fmt::arg_ref refs[] = {log_fmt::make_arg_ref(args)..., log_fmt::arg_ref{nullptr, nullptr, nullptr}};
+
+	// Строка формата не имеет статического времени жизни: в бортовой самописец
+	// и бинарный лог-файл записывается сформированный текст
+	if(recorder && (flags & LOG_LVL_BIT_MASK) <= rec_lvl){
+		log_stage stage;
+		Logging::format_site(stage.buf(), fmt, refs, sizeof...(Args));
+		this->record(flags, stamp, "%s", true, std::string_view(stage.buf().data(), stage.buf().size()));
 	}
 
-	return ret;
+	log_lvl_t curr_lvl = this->lvl_of(mod);
+	if(site_mode == log_site_ctl::mode_on) curr_lvl = std::max<log_lvl_t>(curr_lvl, flags & LOG_LVL_BIT_MASK);
+	if(!passes(flags, curr_lvl)) return 0;
+
+	if(binary){
+		log_stage stage;
+		Logging::format_site(stage.buf(), fmt, refs, sizeof...(Args));
+		return this->to_binary(mod, flags, stamp, "%s", std::string_view(stage.buf().data(), stage.buf().size()));
+	}
+
+	return this->emit(mod, flags, curr_lvl, stamp,
+		[&](log_buf &out){ Logging::format_site(out, fmt, refs, sizeof...(Args)); }, &fmt.site);
 }
 
-template <typename T>
-const char* fmt_of(T arg)
+template<typename... Args>
+void Logging::record(log_lvl_t flags, stamp_t stamp, const char *fmt, bool fmt_static, const Args&... args) const
 {
-	std::string arg_type = typeid(arg).name();
-
-	// log_msg(MSG_OVERTRACE, "%s arg_type: %s\n", __func__, arg_type);
-
-	// Определение формата вывода для текущего параметра
-	if(arg_type.find("basic_string") != std::string::npos) return "%s"; // std::string
-	if(arg_type == "i") return "%d";    // int
-	if(arg_type == "l") return "%ld";   // long
-	if(arg_type == "x") return "%lld";  // long long
-	if(arg_type == "j") return "%u";    // unsigned
-	if(arg_type == "m") return "%lu";   // unsigned long
-	if(arg_type == "y") return "%llu";  // unsigned long long
-	if(arg_type == "f") return "%f";    // float
-	if(arg_type == "d") return "%f";    // double
-	if(arg_type == "e") return "%Lf";   // long double
-	if(arg_type == "b") return "%s";    // bool
-
-	return "";
+	if((flags & LOG_LVL_BIT_MASK) > rec_lvl) return;
+
+	uint64_t pos;
+	rec_slot &slot = rec_begin(pos);
+	log_bin::writer w(slot.data, sizeof slot.data);
+	slot.fmt = fmt_static ? fmt : nullptr;
+	if(!fmt_static) w.str(fmt, std::strlen(fmt));
+	slot.fmt_end = (uint16_t)w.size();
+	w.u8((uint8_t)sizeof...(args));
+	int expand[] = {0, (log_bin::put_arg(w, args), 0)...};
+	(void)expand;
+
+	rec_commit(slot, pos, flags, stamp, w, fmt);
 }
 
+template<typename Body>
+int Logging::emit(const log_module *mod, log_lvl_t flags, log_lvl_t curr_lvl, stamp_t stamp, Body &&body,
+	const log_site *site) const
+{
+	uint8_t dest = dest_of(flags, curr_lvl);
+	if(!dest) return 0;
+	this->count_emitted(flags);
+
+	// Запись формируется целиком (штамп + текст) в буфере потока и выводится одной операцией
+	log_stage stage;
+	log_buf &rec = stage.buf();
+	rec.commit(Logging::make_msg_stamp(rec.tail(LOG_STAMP_MAX_LEN), LOG_STAMP_MAX_LEN, stamp, name_of(mod), stamp_fmt));
+	size_t stamp_len = rec.size();
+	body(rec);
+	if(log_limit::pending().n) Logging::add_suppressed(rec, site);
+
+	// Подсветка только для терминала: выбирается подготовленный при компиляции префикс, текст не просматривается
+	if(site && site->color_len && console_color && (dest & dest_stdout) && rec.size() >= stamp_len + site->plain_len){
+		rec_color color{site->color, site->color_len, stamp_len, site->plain_len};
+		this->write_record(dest, rec.data(), rec.size(), &color);
+	}
+	else this->write_record(dest, rec.data(), rec.size());
+	return (int)(rec.size() - stamp_len);
+}
+
+template<typename... Args>
+int Logging::to_binary(const log_module *mod, log_lvl_t flags, stamp_t stamp, const char *fmt, const Args&... args) const
+{
+	if( sets.log_fname == "" || !sets.log_max_fsize ) return 0;
+
+	// Запись формируется в буфере потока: блок дампа может превышать LOG_RECORD_MAX_LEN
+	size_t cap = LOG_RECORD_MAX_LEN;
+	int sizes[] = {0, (cap += log_bin::extra_size(args), 0)...};
+	(void)sizes;
+
+	log_stage stage;
+	char *rec = stage.buf().tail(cap);
+	log_bin::writer w(rec, cap);
+
+	this->bin_header(w, name_of(mod), flags, stamp, fmt);
+	w.u8((uint8_t)sizeof...(args));
+	int expand[] = {0, (log_bin::put_arg(w, args), 0)...};
+	(void)expand;
+
+	// Запись не помещается в буфер
+	if(!w.ok()){
+		this->count_dropped(stats_t::drop_too_long);
+		return 0;
+	}
+
+	this->count_emitted(flags);
+	return this->write_binary(flags, rec, w.size());
+}
+
+template<typename T>
+log_event& log_event::kv(std::string_view key, const T &v)
+{
+	if(!log) return *this;
+
+	if(dest){
+		log_json::put_key(stage->buf(), key);
+		log_json::put_value(stage->buf(), v);
+	}
+	else if(fields < UINT8_MAX){
+		w.str(key.data(), key.size());
+		log_bin::put_field(w, v);
+		++fields;
+	}
+
+	return *this;
+}
+
+// Вывод статистики логера по спецификатору %s
+template<>
+struct log_formatter<Logging::stats_t>{
+	static void format(log_buf &out, const Logging::stats_t &s);
+};
+
+// 16-ричный дамп блока байт бинарного лог-файла (в том же виде, что и Logging::hex_dump())
+template<>
+struct log_formatter<log_bin::blob>{
+	static void format(log_buf &out, const log_bin::blob &b);
+};
+
 inline std::string method_name(const std::string &pretty_function)
 {
 	size_t colons = pretty_function.find("::");
@@ -342,13 +1055,24 @@ inline std::string method_name(const std::string &pretty_function)
 	return pretty_function.substr(begin, end) + "()";
 }
 
-#define __METHOD_NAME__ method_name(__PRETTY_FUNCTION__)
+// Имя метода ("Class::method()") и префикс "func():line " выделяются из __PRETTY_FUNCTION__
+// при компиляции и хранятся в статической памяти места вызова
+#define LOG_METHOD_NAME ({ 											\
+	static constexpr auto log_method = log_site_text::method<log_site_text::method_size(__PRETTY_FUNCTION__)>(__PRETTY_FUNCTION__); \
+	std::string_view(log_method.s, log_method.len); 				\
+})
+#define LOG_FUNC_LINE ({ 											\
+	static constexpr auto log_func_line = log_site_text::func_line(__func__, __LINE__); \
+	std::string_view(log_func_line.s, log_func_line.len); 			\
+})
+
+#define __METHOD_NAME__ std::string(LOG_METHOD_NAME)
 
 // Функциональный макрос для формирования сообщения в месте возниковения исключения функции
-#define excp_func(str) ( (std::string)__func__ + "():" + std::to_string(__LINE__) + " " + (str) )
+#define excp_func(str) ( std::string(LOG_FUNC_LINE) + (str) )
 
 // Функциональный макрос для формирования сообщения в месте возниковения исключения метода класса
-#define excp_method(str) ( __METHOD_NAME__ + ": " + (str) )
+#define excp_method(str) ( std::string(LOG_METHOD_NAME) + ": " + (str) )
 
 // Название модуля при подключении логера для штампа сообщений
 #ifdef LOG_MODULE_NAME
@@ -357,82 +1081,99 @@ inline std::string method_name(const std::string &pretty_function)
 	#define MODULE_NAME 	""
 #endif
 
+// Модуль единицы трансляции: получается из реестра при первом обращении и хранится в статической
+// памяти. Макросы логирования передают его с каждой записью - имя модуля попадает в штамп записи,
+// уровень модуля (если задан) заменяет уровень логера. Общее состояние логера не изменяется,
+// поэтому модули логируют одновременно без блокировок и копирования имени
+static inline log_module& log_this_module()
+{
+	static log_module &mod = log_module::get(MODULE_NAME);
+	return mod;
+}
+
+// Строка формата функциональных макросов в виде литерала разбирается и проверяется на соответствие
+// типам аргументов при компиляции (см. LOG_FMT). Строка формата, заданная во время выполнения
+// (const char*, std::string), разбирается при каждом вызове (см. LOG_SITE_ARG).
+// Каждое раскрытие макроса формирует при компиляции описатель места вызова (см. LOG_SITE):
+// префикс, файл, функция и строка входят в строку формата и не форматируются при вызове
+
+// Ограничение частоты вывода в месте вызова: stmt - любой макрос логирования (logging_*, log_*).
+// Состояние хранится в статической памяти места вызова, пропуск записи не требует блокировок
+// и форматирования. Число пропущенных записей дописывается к следующей выведенной: "[N suppressed]"
+#define LOG_LIMITED(cond, stmt...) do{				\
+	static log_limit log_site_limit;				\
+	if(!log_site_limit.cond) break;					\
+	log_limit::report log_site_report(log_site_limit); \
+	stmt;											\
+}while(0)
+
+// Каждая n-я запись, первые n записей, не чаще одной записи за ms [мс], с вероятностью p
+#define log_every_n(n, stmt...)		LOG_LIMITED(every_n(n), stmt)
+#define log_first_n(n, stmt...)		LOG_LIMITED(first_n(n), stmt)
+#define log_every_ms(ms, stmt...)	LOG_LIMITED(every_ms(ms), stmt)
+#define log_sampled(p, stmt...)		LOG_LIMITED(sampled(p), stmt)
+
 // Функциональный макрос формирования сообщения
-#define logging_msg(obj, flags, str...) do{			\
-	std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex); \
-	(obj).set_module_name(MODULE_NAME); 			\
-	(obj).msg(flags, str); 							\
+#define logging_msg(obj, flags, fmt, args...) do{	\
+	if(!log_lvl_compiled(flags)) break;				\
+	LOG_SITE(flags, "", log_site::loc_none, "", fmt, "");	\
+	(obj).msg(log_this_module(), flags, LOG_SITE_ARG(fmt), ##args); \
 }while(0)
 
+// Функциональные макросы подробных сообщений (удаляются из сборки при LOG_COMPILE_LVL ниже их уровня)
+#define logging_verbose(obj, str...)	logging_msg(obj, MSG_VERBOSE, str)
+#define logging_trace(obj, str...)		logging_msg(obj, MSG_TRACE, str)
+
 // Функциональный макрос формирования сообщения без Штампа
-#define logging_msg_ns(obj, flags, str...) do{ 		\
-	std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex); \
-	Logging::stamp_t tmp = (obj).get_time_stamp(); 	\
-	(obj).set_time_stamp(Logging::no_stamp); 		\
-	(obj).msg(flags, str); 							\
-	(obj).set_time_stamp(tmp); 						\
+#define logging_msg_ns(obj, flags, fmt, args...) do{ \
+	if(!log_lvl_compiled(flags)) break;				\
+	LOG_SITE(flags, "", log_site::loc_none, "", fmt, "");	\
+	(obj).msg(log_this_module(), flags, Logging::no_stamp, LOG_SITE_ARG(fmt), ##args); \
 }while(0)
 
+// Макросы ниже формируют одну запись за вызов: префикс, место вызова и текст сообщения
+// объединяются в одну строку формата при компиляции (описатель места вызова)
+
 // Функциональный макрос формирования сообщения об Исключении
+// (описание исключения обычно известно только во время выполнения - формат разбирается при вызове)
 #define logging_excp(obj, str...) do{				\
-	std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex); \
-	(obj).set_module_name(MODULE_NAME); 			\
-	Logging::stamp_t tmp = (obj).get_time_stamp(); 	\
-	(obj).msg(MSG_ERROR | MSG_TO_FILE, _RED "EX: " _RESET "(in %s) ", __func__); \
-	(obj).set_time_stamp(Logging::no_stamp); 		\
-	(obj).msg(MSG_ERROR | MSG_TO_FILE, str); 		\
-	(obj).set_time_stamp(tmp); 						\
+	log_buf log_excp_text;							\
+	log_fmt::format(log_excp_text, str);			\
+	LOG_SITE(MSG_ERROR | MSG_TO_FILE, _RED "EX: " _RESET, log_site::loc_func, "", "%s", ""); \
+	(obj).msg(log_this_module(), MSG_ERROR | MSG_TO_FILE, LOG_SITE_ARG("%s"), \
+		std::string_view(log_excp_text.data(), log_excp_text.size())); \
 }while(0)
 
 // Функциональный макрос формирования Предупреждающего сообщения
-#define logging_warn(obj, str...)	do{ 				\
-	std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex); \
-	(obj).set_module_name(MODULE_NAME); 			\
-	Logging::stamp_t tmp = (obj).get_time_stamp(); 	\
-	(obj).msg(MSG_WARNING | MSG_TO_FILE, _YELLOW _BOLD "WARN: " _RESET); \
-	(obj).set_time_stamp(Logging::no_stamp); 		\
-	(obj).msg(MSG_WARNING| MSG_TO_FILE, str); 		\
-	(obj).set_time_stamp(tmp); 						\
+#define logging_warn(obj, fmt, args...)	do{ 		\
+	LOG_SITE(MSG_WARNING | MSG_TO_FILE, _YELLOW _BOLD "WARN: " _RESET, log_site::loc_none, "", fmt, ""); \
+	(obj).msg(log_this_module(), MSG_WARNING | MSG_TO_FILE, LOG_SITE_ARG(fmt), ##args); \
 }while(0)
 
 // Функциональный макрос формирования Информационного сообщения
-#define logging_info(obj, str...) do{				\
-	std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex); \
-	(obj).set_module_name(MODULE_NAME); 			\
-	Logging::stamp_t tmp = (obj).get_time_stamp(); 	\
-	(obj).msg(MSG_INFO | MSG_TO_FILE, _YELLOW "INFO: " _RESET); \
-	(obj).set_time_stamp(Logging::no_stamp); 		\
-	(obj).msg(MSG_INFO | MSG_TO_FILE, str); 		\
-	(obj).set_time_stamp(tmp); 						\
+#define logging_info(obj, fmt, args...) do{			\
+	LOG_SITE(MSG_INFO | MSG_TO_FILE, _YELLOW "INFO: " _RESET, log_site::loc_none, "", fmt, ""); \
+	(obj).msg(log_this_module(), MSG_INFO | MSG_TO_FILE, LOG_SITE_ARG(fmt), ##args); \
 }while(0)
 
 // Функциональный макрос формирования сообщения об Ошибке
-#define logging_err(obj, str...)	do{ 			\
-	std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex); \
-	(obj).set_module_name(MODULE_NAME); 			\
-	Logging::stamp_t tmp = (obj).get_time_stamp(); 	\
-	(obj).msg(MSG_ERROR | MSG_TO_FILE, _RED _BOLD "ERR: " _BOLD "%s %s():%d " _RESET, __FILE__, __func__, __LINE__ ); \
-	(obj).set_time_stamp(Logging::no_stamp); 		\
-	(obj).msg(MSG_ERROR | MSG_TO_FILE, str); 		\
-	(obj).set_time_stamp(tmp); 						\
+#define logging_err(obj, fmt, args...)	do{ 		\
+	LOG_SITE(MSG_ERROR | MSG_TO_FILE, _RED _BOLD "ERR: " _BOLD, log_site::loc_full, _RESET, fmt, ""); \
+	(obj).msg(log_this_module(), MSG_ERROR | MSG_TO_FILE, LOG_SITE_ARG(fmt), ##args); \
 }while(0)
 
 // Функциональный макрос формирования сообщения о Системной ошибке
-#define logging_perr(obj, str...) do{ 				\
-	std::lock_guard<std::recursive_mutex> lock(Logging::log_print_mutex); \
-	(obj).set_module_name(MODULE_NAME); 			\
-	Logging::stamp_t tmp = (obj).get_time_stamp(); 	\
-	(obj).msg(MSG_ERROR | MSG_TO_FILE, _RED _BOLD "PERR: " _BOLD "%s %s():%d " _RESET, __FILE__, __func__, __LINE__); \
-	(obj).set_time_stamp(Logging::no_stamp); 		\
-	(obj).msg(MSG_ERROR | MSG_TO_FILE, str); 		\
-	(obj).msg(MSG_ERROR | MSG_TO_FILE, ":%s\n", strerror(errno)); \
-	(obj).set_time_stamp(tmp); 						\
+#define logging_perr(obj, fmt, args...) do{ 		\
+	const char *log_perr_str = strerror(errno);		\
+	LOG_SITE(MSG_ERROR | MSG_TO_FILE, _RED _BOLD "PERR: " _BOLD, log_site::loc_full, _RESET, fmt, ":%s\n"); \
+	(obj).msg(log_this_module(), MSG_ERROR | MSG_TO_FILE, LOG_SITE_ARG(fmt), ##args, log_perr_str); \
 }while(0)
 
 // Функциональный макрос вывода дампа массива байт
 #define logging_hexdump(obj, flags, buf, len, msg) do{	\
-	(obj).set_module_name(MODULE_NAME);				\
-	(obj).hex_dump(flags, buf, len, msg);			\
+	if(!log_lvl_compiled(flags)) break;				\
+	LOG_SITE(flags, "", log_site::loc_none, "", "%s", "");	\
+	(obj).hex_dump(log_this_module(), flags, LOG_SITE_ARG("%s"), buf, len, msg); \
 }while(0)
 
 // Логер может работать в разделяемом между разными файлами (модулями) режиме
@@ -444,6 +1185,10 @@ extern Logging logger;
 // Вывод сообщения с меткой времени и даты
 #define log_msg(flags, str...)		logging_msg(logger, flags, str)
 
+// Вывод подробных и трассировочных сообщений
+#define log_verbose(str...)			logging_verbose(logger, str)
+#define log_trace(str...)			logging_trace(logger, str)
+
 // Вывод сообщения без штампа
 #define log_msg_ns(flags, str...) 	logging_msg_ns(logger, flags, str)
 
@@ -0,0 +1,390 @@
+// Набор замеров производительности логера:
+//	- форматирование сообщений: snprintf и форматирование логера (log_format.hpp);
+//	- запись в файл: write() на каждую запись, очередь io_uring (log_uring.hpp)
+//	  и запись логером по одной и пакетами (set_batch) с числом записей на системный вызов;
+//	- сценарии: msg(), макросы logging_*, hex_dump(), структурированные события event()
+//	  и отброшенные по уровню вызовы
+//	  для 1..N потоков и вывода в stdout (/dev/null), в файл, в файл в асинхронном режиме
+//	  (задержка вызова на стороне вызывающего потока, время включает flush()) и без вывода.
+// Для каждого замера выводятся пропускная способность и задержка вызова (p50/p99/p999),
+// результаты дополнительно сохраняются в формате JSON.
+//
+// Использование: logger-bench [-n число итераций на поток] [-t максимальное число потоков] [-j файл JSON]
+// Файл JSON по умолчанию - logger-bench-cpp.json ("-" - вывод в stdout)
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "logger.hpp"
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+// Результат не должен быть отброшен оптимизатором
+volatile size_t sink;
+
+// Результат замера
+struct result_t{
+	std::string group;				// раздел: format, file_write, scenario
+	std::string op;					// измеряемая операция
+	std::string sink;				// назначение вывода
+	unsigned threads = 1;
+	uint64_t calls = 0;				// общее число вызовов
+	double seconds = 0;				// общее время
+	bool latency = false;			// задержки вызова измерены
+	double p50 = 0, p99 = 0, p999 = 0, max = 0;		// [нс]
+	double syscalls = -1;			// системных вызовов на вызов (< 0 - не измерялось)
+};
+
+std::vector<result_t> results;
+
+void print_result(const result_t &r)
+{
+	std::printf("%-12s %-26s %-8s %2u th %10.1f ns/call %11.0f calls/s",
+		r.group.c_str(), r.op.c_str(), r.sink.c_str(), r.threads, r.seconds * 1e9 / r.calls, r.calls / r.seconds);
+	if(r.latency) std::printf("  p50 %7.0f  p99 %7.0f  p999 %8.0f ns", r.p50, r.p99, r.p999);
+	if(r.syscalls >= 0) std::printf("  %6.3f syscalls/call", r.syscalls);
+	if(r.syscalls > 0) std::printf("  %7.1f rec/syscall", 1 / r.syscalls);
+	std::printf("\n");
+	std::fflush(stdout);
+}
+
+// Пропускная способность: iters вызовов fn(i) в одном потоке (без замера задержки отдельных вызовов)
+template<typename Fn>
+void run(const char *group, const char *name, size_t iters, Fn &&fn)
+{
+	// Прогрев
+	for(size_t i = 0; i < iters / 10; ++i) fn(i);
+
+	auto start = bench_clock::now();
+	for(size_t i = 0; i < iters; ++i) fn(i);
+
+	result_t r;
+	r.group = group;
+	r.op = name;
+	r.sink = "none";
+	r.calls = iters;
+	r.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+	print_result(r);
+	results.push_back(r);
+}
+
+// Расчет процентилей по задержкам всех потоков
+void percentiles(result_t &r, std::vector<uint32_t> &lat)
+{
+	if(lat.empty()) return;
+
+	auto at = [&lat](double q){
+		size_t k = std::min(lat.size() - 1, (size_t)(q * lat.size()));
+		std::nth_element(lat.begin(), lat.begin() + k, lat.end());
+		return (double)lat[k];
+	};
+
+	r.latency = true;
+	r.p50 = at(0.5);
+	r.p99 = at(0.99);
+	r.p999 = at(0.999);
+	r.max = *std::max_element(lat.begin(), lat.end());
+}
+
+// Задержка каждого вызова и общая пропускная способность: threads потоков по iters вызовов fn(th, i).
+// Потоки начинают замер одновременно после прогрева. finish() выполняется после завершения
+// потоков и входит в общее время
+template<typename Fn, typename Finish>
+result_t measure(const char *group, const char *op, const char *sink_name, unsigned threads, size_t iters,
+	Fn &&fn, Finish &&finish)
+{
+	std::vector<std::vector<uint32_t>> lat(threads, std::vector<uint32_t>(iters));
+	std::vector<std::thread> workers;
+	std::atomic<unsigned> ready{0};
+	std::atomic<bool> go{false};
+
+	for(unsigned th = 0; th < threads; ++th){
+		workers.emplace_back([&, th]{
+			std::vector<uint32_t> &l = lat[th];
+			for(size_t i = 0; i < std::min<size_t>(iters / 10, 1000); ++i) fn(th, i);
+
+			ready.fetch_add(1);
+			while(!go.load(std::memory_order_acquire)) std::this_thread::yield();
+
+			for(size_t i = 0; i < iters; ++i){
+				auto t = bench_clock::now();
+				fn(th, i);
+				l[i] = (uint32_t)std::min<int64_t>(UINT32_MAX,
+					std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - t).count());
+			}
+		});
+	}
+
+	while(ready.load() < threads) std::this_thread::yield();
+	auto start = bench_clock::now();
+	go.store(true, std::memory_order_release);
+
+	for(auto &w : workers) w.join();
+	finish();
+
+	result_t r;
+	r.group = group;
+	r.op = op;
+	r.sink = sink_name;
+	r.threads = threads;
+	r.calls = (uint64_t)threads * iters;
+	r.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+	std::vector<uint32_t> all;
+	all.reserve(r.calls);
+	for(auto &l : lat) all.insert(all.end(), l.begin(), l.end());
+	percentiles(r, all);
+	return r;
+}
+
+// Вывод stdout процесса в /dev/null на время замера
+class stdout_redirect
+{
+public:
+	explicit stdout_redirect(bool enable){
+		if(!enable) return;
+		std::fflush(stdout);
+		saved = ::dup(STDOUT_FILENO);
+		int fd = ::open("/dev/null", O_WRONLY);
+		if(fd >= 0){
+			::dup2(fd, STDOUT_FILENO);
+			::close(fd);
+		}
+	}
+	~stdout_redirect(){
+		if(saved < 0) return;
+		std::fflush(stdout);
+		::dup2(saved, STDOUT_FILENO);
+		::close(saved);
+	}
+
+private:
+	int saved = -1;
+};
+
+void remove_logs(const std::string &name)
+{
+	::unlink(name.c_str());
+	for(int i = 1; i <= 2; ++i) ::unlink((name + "." + std::to_string(i)).c_str());
+}
+
+// Замеры сценариев: операция x назначение вывода x число потоков (1, 2, 4 ... max_threads)
+void run_scenarios(size_t iters, unsigned max_threads)
+{
+	const char *ops[] = {"msg", "logging_err", "hex_dump", "event", "filtered"};
+	const char *sinks[] = {"none", "devnull", "file", "async"};
+	const std::string fname = "logger-bench.log";
+
+	const std::string name{"connection"};
+	uint8_t dump[64];
+	for(size_t i = 0; i < sizeof dump; ++i) dump[i] = (uint8_t)i;
+
+	std::printf("\nScenarios: %zu calls per thread, 1..%u threads\n", iters, max_threads);
+
+	for(const char *sink_name : sinks){
+		bool async = !std::strcmp(sink_name, "async");
+		bool to_file = async || !std::strcmp(sink_name, "file");
+		bool to_stdout = !std::strcmp(sink_name, "devnull");
+
+		for(const char *op : ops){
+			for(unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)){
+				// Вывод в stdout разрешен уровнем только для devnull, в файл - только для file и async
+				Logging logger(to_stdout ? MSG_DEBUG : MSG_SILENT, "[ BENCH ]", to_file ? fname : "", 2, MB_to_B(64));
+				logger.set_time_stamp(Logging::us_time);
+				if(async) logger.set_async(true);
+
+				auto call = [&](unsigned th, size_t i){
+					switch(op[0]){
+						case 'm':
+							logger.msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("%s #%u: %zu bytes, load %.3f\n"), name, th, i, 0.734);
+							break;
+						case 'l':
+							logging_err(logger, "%s #%u: request %zu failed\n", name, th, i);
+							break;
+						case 'h':
+							logger.hex_dump(MSG_DEBUG | MSG_TO_FILE, dump, sizeof dump, "dump: ");
+							break;
+						case 'e':
+							logger.event(MSG_DEBUG | MSG_TO_FILE, "request").kv("conn", name).kv("thread", th)
+								.kv("bytes", i).kv("load", 0.734);
+							break;
+						default:
+							logger.msg(MSG_TRACE, LOG_FMT("%s #%u: %zu bytes\n"), name, th, i);
+							break;
+					}
+				};
+
+				result_t r;
+				{
+					stdout_redirect redirect(to_stdout);
+					r = measure("scenario", op, sink_name, threads, iters, call, [&]{ logger.flush(); });
+				}
+				print_result(r);
+				results.push_back(r);
+
+				if(threads >= max_threads) break;
+			}
+		}
+		if(to_file) remove_logs(fname);
+	}
+}
+
+// Сохранение результатов в формате JSON
+bool write_json(const char *path, size_t iters, unsigned max_threads)
+{
+	std::FILE *fp = std::strcmp(path, "-") ? std::fopen(path, "w") : stdout;
+	if(!fp){
+		std::perror(path);
+		return false;
+	}
+
+	std::fprintf(fp, "{\n  \"suite\": \"logger-cpp\",\n  \"iterations\": %zu,\n  \"max_threads\": %u,\n  \"results\": [\n",
+		iters, max_threads);
+
+	for(size_t i = 0; i < results.size(); ++i){
+		const result_t &r = results[i];
+		std::fprintf(fp, "    {\"group\": \"%s\", \"op\": \"%s\", \"sink\": \"%s\", \"threads\": %u, "
+			"\"calls\": %llu, \"seconds\": %.6f, \"ns_per_call\": %.1f, \"calls_per_sec\": %.0f",
+			r.group.c_str(), r.op.c_str(), r.sink.c_str(), r.threads, (unsigned long long)r.calls, r.seconds,
+			r.seconds * 1e9 / r.calls, r.calls / r.seconds);
+		if(r.latency){
+			std::fprintf(fp, ", \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f",
+				r.p50, r.p99, r.p999, r.max);
+		}
+		if(r.syscalls >= 0) std::fprintf(fp, ", \"syscalls_per_call\": %.4f", r.syscalls);
+		if(r.syscalls > 0) std::fprintf(fp, ", \"records_per_syscall\": %.1f", 1 / r.syscalls);
+		std::fprintf(fp, "}%s\n", (i + 1 < results.size()) ? "," : "");
+	}
+
+	std::fprintf(fp, "  ]\n}\n");
+	if(fp != stdout) std::fclose(fp);
+	return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	size_t iters = 100000;
+	unsigned max_threads = 4;
+	const char *json_path = "logger-bench-cpp.json";
+
+	for(int i = 1; i < argc; ++i){
+		if(!std::strcmp(argv[i], "-n") && i + 1 < argc) iters = std::strtoull(argv[++i], nullptr, 10);
+		else if(!std::strcmp(argv[i], "-t") && i + 1 < argc) max_threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+		else if(!std::strcmp(argv[i], "-j") && i + 1 < argc) json_path = argv[++i];
+		else{
+			std::printf("Usage: %s [-n iterations] [-t max_threads] [-j results.json]\n", argv[0]);
+			return std::strcmp(argv[i], "-h") ? 1 : 0;
+		}
+	}
+	if(!iters) iters = 1;
+	if(!max_threads) max_threads = 1;
+
+	const std::string name{"connection"};
+	const double load = 0.734;
+	const unsigned long bytes = 1048576;
+	const size_t fmt_iters = iters * 10;
+
+	std::printf("Formatting: \"%%s #%%d: %%lu bytes, load %%.3f, id %%#x\" (%zu iterations)\n", fmt_iters);
+
+	run("format", "snprintf", fmt_iters, [&](size_t i){
+		char buf[LOG_RECORD_MAX_LEN];
+		sink = std::snprintf(buf, sizeof buf, "%s #%d: %lu bytes, load %.3f, id %#x\n",
+			name.c_str(), (int)i, bytes + i, load, (unsigned)i);
+	});
+
+	run("format", "log_fmt (runtime format)", fmt_iters, [&](size_t i){
+		log_buf buf;
+		log_fmt::format(buf, "%s #%d: %lu bytes, load %.3f, id %#x\n", name, (int)i, bytes + i, load, (unsigned)i);
+		sink = buf.size();
+	});
+
+	run("format", "log_fmt (LOG_FMT)", fmt_iters, [&](size_t i){
+		log_buf buf;
+		log_fmt::format(buf, LOG_FMT("%s #%d: %lu bytes, load %.3f, id %#x\n"), name, (int)i, bytes + i, load, (unsigned)i);
+		sink = buf.size();
+	});
+
+	std::printf("\nIntegers only: \"%%d %%d %%d %%d\"\n");
+
+	run("format", "snprintf (ints)", fmt_iters, [&](size_t i){
+		char buf[LOG_RECORD_MAX_LEN];
+		sink = std::snprintf(buf, sizeof buf, "%d %d %d %d\n", (int)i, -(int)i, (int)(i * 7), 42);
+	});
+
+	run("format", "log_fmt (LOG_FMT, ints)", fmt_iters, [&](size_t i){
+		log_buf buf;
+		log_fmt::format(buf, LOG_FMT("%d %d %d %d\n"), (int)i, -(int)i, (int)(i * 7), 42);
+		sink = buf.size();
+	});
+
+	// Запись в файл: файл создается в текущем каталоге и удаляется после замера
+	const char *fname = "logger-bench.tmp";
+	std::printf("\nFile write: %zu records\n", iters);
+
+	auto record = [](char *rec, size_t i){
+		return (size_t)std::snprintf(rec, LOG_RECORD_MAX_LEN, "[ 01.01.26 00:00:00 ][ BENCH ] record #%zu payload\n", i);
+	};
+
+	int fd = ::open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if(fd < 0){
+		std::perror(fname);
+		return 1;
+	}
+	{
+		result_t r = measure("file_write", "write()", "file", 1, iters,
+			[&](unsigned, size_t i){ char rec[LOG_RECORD_MAX_LEN]; sink = ::write(fd, rec, record(rec, i)); },
+			[]{});
+		r.syscalls = 1;
+		print_result(r);
+		results.push_back(r);
+	}
+	::close(fd);
+
+	fd = ::open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	{
+		log_uring u;
+		u.attach(fd, 0);
+		result_t r = measure("file_write", u.is_native() ? "io_uring" : "io_uring (pwrite fallback)", "file", 1, iters,
+			[&](unsigned, size_t i){ char rec[LOG_RECORD_MAX_LEN]; sink = u.write(rec, record(rec, i)); },
+			[&]{ u.drain(); });
+		r.syscalls = (double)u.syscalls() / r.calls;
+		print_result(r);
+		results.push_back(r);
+	}
+	::close(fd);
+	::unlink(fname);
+
+	// Запись логером: каждая запись своим write() и пакетами в буфере 64 КБ (запись ошибки - сразу)
+	const std::string log_name = "logger-bench-batch.log";
+	for(size_t batch : {(size_t)0, (size_t)LOG_BATCH_SIZE}){
+		Logging logger(MSG_SILENT, "[ BENCH ]", log_name, 2, MB_to_B(64));
+		if(batch) logger.set_batch(batch);
+		result_t r = measure("file_write", batch ? "Logging batch 64K" : "Logging write()", "file", 1, iters,
+			[&](unsigned, size_t i){
+				if(i % 1000 == 999) logging_err(logger, "record #%zu failed\n", i);
+				else logger.msg(MSG_DEBUG | MSG_TO_FILE, LOG_FMT("record #%zu payload\n"), i);
+			},
+			[&]{ logger.flush(); });
+		Logging::stats_t st = logger.stats();
+		r.syscalls = st.records_file ? (double)st.writes_file / st.records_file : 0;
+		print_result(r);
+		results.push_back(r);
+		remove_logs(log_name);
+	}
+
+	run_scenarios(iters, max_threads);
+
+	return write_json(json_path, iters, max_threads) ? 0 : 1;
+}